@@ -8,8 +8,6 @@
  * Purpose:	To communicate with a DS1307 Real Time Clock via a TWI interface. 
  *
  * Dependencies:
- *          util/delay.h: After transmitting data to the DS1307, the program will wait for 
- *                        it to process the data.
  *          stdint.h      This library uses data types defined in this header. stdint.h is
  *                        part of the C standard library.
  *          twi.h:        This library is designed to work with a TWI interface.
@@ -38,20 +36,12 @@
 
 
 
+#include "hal.h"
 #include "twi.h"
+#include "prof.h"
 #include "ds1307.h"
 
 
-/*
- *     F_CPU has to be defined in order to use the delay function in util/delay.h
- *     if you use a 16Mhz crystal as a clock for the mcu, then leave this unchanged, 
- *     if not alter it accordingly
- */
-#ifndef F_CPU
-#define F_CPU 16000000ul
-#endif
-#include <util/delay.h>
-
 #define DS1307_I2C_ADDRESS 0x68
 
  
@@ -83,19 +73,52 @@ static bool is_leap(unsigned int year)
  *     \param d     Day   (1 - 31)
  *     \return      True if date is valid, false if not.
  */
+/*
+ *     Calendar tables, indexed by month (1 - 12). days_before_month is the number 
+ *     of days from 1. Jan. to the first day of the month in a non-leap year.
+ *     Both tables are constant expressions, so they can be checked at compile time, 
+ *     and are stored in program memory.
+ */
+static constexpr uint8_t  days_in_month[13]     PROGMEM = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+static constexpr uint16_t days_before_month[13] PROGMEM = {0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+static_assert(days_before_month[12] + days_in_month[12] == 365, "calendar tables don't add up to a year");
+static_assert(days_before_month[3] == days_in_month[1] + days_in_month[2], "calendar tables don't match");
+
 static bool is_valid_date(uint8_t y, uint8_t m, uint8_t d)
 {
-	if (d > 31 || d == 0) return false;						//  Day can not be 0 or larger than 31 in any case.
-	else if (m == 4 || m == 6 || m == 9 || m == 11)					//  If month is apr, jun, sep or nov ...
-	{
-		if (d == 31) return false;						//  ... and day is 31, the date is invalid.
-	}
-	else if (m == 2)								//  If month is feb ...
-	{
-		if (d >= 30) return false;						//  ... and day is 30 or 31 ...
-		else if(d == 29 && !is_leap(y)) return false;				//  ... or 29 in a non-leap year, the date is invalid.
-	}
-	return true;
+	if (d == 0 || m == 0 || m > 12) return false;					//  Day and month can not be 0, and there are only 12 months.
+	if (m == 2 && is_leap(y)) return d <= 29;					//  29. Feb. is valid in a leap year.
+	return d <= pgm_read_byte(&days_in_month[m]);
+}
+
+/*
+ *     The number of days from 01.01.2000 to a given date. Every fourth year 
+ *     from 2000 to 2099 is a leap year, 2000 included.
+ *
+ *     \param y     Year  (0 - 99)
+ *     \param m     Month (1 - 12)
+ *     \param d     Day   (1 - 31)
+ *     \return      Days since 01.01.2000.
+ */
+static uint16_t days_since_2000(uint8_t y, uint8_t m, uint8_t d)
+{
+	uint16_t days = y * 365u + (y + 3) / 4;						//  whole years, plus one day for each leap year before y
+	days += pgm_read_word(&days_before_month[m]) + d - 1;
+	if (m > 2 && (y & 0x03) == 0) days++;						//  past 29. Feb. in a leap year
+	return days;
+}
+
+/*
+ *     The number of seconds of a day, 0 - 86399.
+ *
+ *     \param h     Hour    (0 - 23)
+ *     \param m     Minute  (0 - 59)
+ *     \param s     Seconds (0 - 59)
+ */
+static uint32_t seconds_of_day(uint8_t h, uint8_t m, uint8_t s)
+{
+	return (uint32_t)h * 3600 + m * 60u + s;
 }
 
 /*
@@ -152,6 +175,22 @@ static uint8_t bcd2dec(uint8_t bcd)
 	return (bcd & 0x0f) + ((bcd >> 4) * 10);
 }
 
+/*
+ *     Convert an hour register to 24 hour format regardless of the 12/24 hour mode 
+ *     bit. 12 AM is 0 and 12 PM is 12.
+ *
+ *     \param data    Raw data read from DS1307 register 0x02.
+ *     \return        Hour (0 - 23).
+ */
+static uint8_t hour_register_to_24(uint8_t data)
+{
+	if (!(data & 0x40)) return bcd2dec(data & 0x3F);				//  24 hour mode
+	
+	uint8_t h = bcd2dec(data & 0x1F) % 12;						//  12 AM -> 0, 12 PM -> 0 ...
+	if (data & 0x20) h += 12;							//  ... -> 12
+	return h;
+}
+
 /*
  *     The DS1307 class has a pointer to a function as a member. That pointer will
  *     point to one of the two following functions depending on 12/24 hour mode.
@@ -203,6 +242,12 @@ DS1307::DS1307()
 	_clkh = 0x00;
 	_mode = DSMODE24;
 	_mi = AM;
+	
+	_ticks = 0;
+	_sync_interval = 0;
+	_since_sync = 0;
+	_last_tick = 0;
+	_tick_timer = false;
 	     
 	     //  set function pointer to read_24_hr (24 hour mode)
 	read_hr = &read_24_hr;
@@ -235,22 +280,18 @@ void DS1307::init()
  */
 void DS1307::set_mode(DSMODE m)
 {
-	unsigned char temp_data;
-	read_register(0x02, &temp_data);					//  register 0x02 is the hour register
-	
 	if (m == DSMODE24)
 	{
-		temp_data &= 0xBF;						//  clear BIT6 (the 12/24 hour mode bit. 0 means 24 hour mode)
+		modify_register(0x02, 0x40, 0x00);				//  clear BIT6 of the hour register (the 12/24 hour mode bit. 0 means 24 hour mode)
 		read_hr = &read_24_hr;						//  redirect pointer to function
 		_mode = DSMODE24;
 	}
 	else if (m == DSMODE12)
 	{
-		temp_data |= 0x40;						//  set BIT6. 1 means 12 hour mode.
+		modify_register(0x02, 0x00, 0x40);				//  set BIT6. 1 means 12 hour mode.
 		read_hr = &read_12_hr;
 		_mode = DSMODE12;
 	}
-	write_register(0x02, temp_data);
 }
 
 /*
@@ -415,28 +456,12 @@ void DS1307::get_dow(uint8_t &dow) const
  */
 void DS1307::transfer_data() const
 {
-		//  don't overwrite clock halt bit
-	uint8_t sec = dec2bcd(_sec);
-	sec |= (_clkh << 7);								//  will set BIT7 if _clck == 0x01;
-	
-		//  the hour data have to be processed before transferred
-	uint8_t hr = dec2bcd(_hr);
-	
-		//  set BIT6 if 12hour mode and bit5 if PM. _mi is always AM(0x00) if in 24 hour mode
-	hr |= (_mode << 6) | (_mi << 5);		
+	uint8_t data[7];
 	
-		//  transfer data
-	twi_open(DS1307_I2C_ADDRESS);							//  Start transmission.
-	twi_write_ch(0x00);								//  Select register 0x00.
-	twi_write_ch(sec);								//  Register 0x00 stores clock halt bit and seconds.
-	twi_write_ch(dec2bcd(_min));							//  The register pointer automatically increments...
-	twi_write_ch(hr);								//  ... after each data byte is written.
-	twi_write_ch(dec2bcd(_dow));
-	twi_write_ch(dec2bcd(_day));
-	twi_write_ch(dec2bcd(_mth));
-	twi_write_ch(dec2bcd(_yr));
-	twi_close();									//  Terminate data transfer by generating a stop condition.
-	_delay_us(100);									//  Wait for chip.
+		//  transfer data, starting with register 0x00 which stores clock halt bit and seconds.
+		//  The register pointer automatically increments after each data byte is written.
+	store(data);
+	write_registers(0x00, data, 7);
 }
 
 /*
@@ -447,10 +472,20 @@ void DS1307::update()
 {
 	unsigned char data[7];								//  Prepare to read 7 bytes of data from DS1307.
 	
-	twi_open(DS1307_I2C_ADDRESS);							//  Open connection and start transmission.
-	twi_read_str(0x00, data, 7);							//  Read 7 bytes starting with register 0x00 into data array.
-	twi_close();									//  Close connection.
-	
+	PROF_START(t);
+	if (!read_registers(0x00, data, 7)) PROF_ERROR(PROF_DS1307);			//  Read 7 bytes starting with register 0x00 into data array.
+	load(data);
+	PROF_STOP(PROF_DS1307, t);
+}
+
+/*
+ *     Private function to process the time and calendar registers and update
+ *     the member fields.
+ *
+ *     \param *data     Registers 0x00 - 0x06.
+ */
+void DS1307::load(const uint8_t *data)
+{
 		//  if 12hour mode, check bit 5 of hour. If set, PM, if clear AM
 	if (_mode == DSMODE12)
 	{
@@ -468,6 +503,140 @@ void DS1307::update()
 	_hr = bcd2dec(read_hr(data[2]));						//  Use pointed function to read/process data.
 }
 
+/*
+ *     Private function to prepare the time and calendar registers from the
+ *     member fields.
+ *
+ *     \param *data     Buffer for registers 0x00 - 0x06.
+ */
+void DS1307::store(uint8_t *data) const
+{
+		//  don't overwrite clock halt bit
+	data[0] = dec2bcd(_sec) | (_clkh << 7);						//  will set BIT7 if _clck == 0x01;
+	data[1] = dec2bcd(_min);
+	
+		//  set BIT6 if 12hour mode and bit5 if PM. _mi is always AM(0x00) if in 24 hour mode
+	data[2] = dec2bcd(_hr) | (_mode << 6) | (_mi << 5);
+	data[3] = dec2bcd(_dow);
+	data[4] = dec2bcd(_day);
+	data[5] = dec2bcd(_mth);
+	data[6] = dec2bcd(_yr);
+}
+
+/*
+ *     Get the date and time of the member fields as seconds since 01.01.2000.
+ *
+ *     \return     Seconds since 01.01.2000 00:00:00.
+ */
+uint32_t DS1307::get_epoch() const
+{
+	uint8_t data[7];
+	
+	store(data);
+	return registers_to_epoch(data);
+}
+
+/*
+ *     Set the date, time and day of week of the member fields from seconds 
+ *     since 01.01.2000.
+ *
+ *     \param t     Seconds since 01.01.2000 00:00:00.
+ *     \return      False if t is past the year 2099.
+ *
+ *     Note:        This function only updates member variables. No data is
+ *                  transferred to the DS1307.
+ */
+bool DS1307::set_epoch(uint32_t t)
+{
+	uint8_t data[7];
+	
+	if (t / 86400 >= 36525u) return false;						//  100 years, 25 of them leap years
+	epoch_to_registers(t, data, _mode);
+	load(data);
+	return true;
+}
+
+/*
+ *     Read the date and time from the DS1307 as seconds since 01.01.2000.
+ *     The member fields are not changed.
+ *
+ *     \param &t    Seconds since 01.01.2000 00:00:00.
+ *     \return      False if the DS1307 did not respond.
+ */
+bool DS1307::read_epoch(uint32_t &t) const
+{
+	uint8_t data[7];
+	
+	if (!read_registers(0x00, data, 7)) return false;
+	t = registers_to_epoch(data);
+	return true;
+}
+
+/*
+ *     Convert the time and calendar registers to seconds since 01.01.2000.
+ *     The day of week register is ignored.
+ *
+ *     \param *data     Registers 0x00 - 0x06.
+ *     \return          Seconds since 01.01.2000 00:00:00.
+ */
+uint32_t DS1307::registers_to_epoch(const uint8_t *data)
+{
+	uint16_t days = days_since_2000(bcd2dec(data[6]), bcd2dec(data[5]), bcd2dec(data[4]));
+	
+	return days * 86400ul + seconds_of_day(hour_register_to_24(data[2]), bcd2dec(data[1]), bcd2dec(data[0] & 0x7F));
+}
+
+/*
+ *     Convert seconds since 01.01.2000 to the time and calendar registers.
+ *     The clock halt bit is clear. 01.01.2000 was a saturday.
+ *
+ *     \param t         Seconds since 01.01.2000 00:00:00, up to 31.12.2099 23:59:59.
+ *     \param *data     Buffer for registers 0x00 - 0x06.
+ *     \param mode      DSMODE24 or DSMODE12, the format of the hour register.
+ */
+void DS1307::epoch_to_registers(uint32_t t, uint8_t *data, DSMODE mode)
+{
+	uint16_t days = t / 86400;
+	uint32_t secs = t - days * 86400ul;
+	
+		//  time of day
+	uint8_t h = secs / 3600;
+	uint16_t r = secs - h * 3600u;
+	data[0] = dec2bcd(r % 60);
+	data[1] = dec2bcd(r / 60);
+	if (mode == DSMODE12)
+	{
+		uint8_t pm = (h >= 12);
+		h %= 12;
+		if (h == 0) h = 12;
+		data[2] = dec2bcd(h) | 0x40 | (pm << 5);
+	}
+	else data[2] = dec2bcd(h);
+	
+	data[3] = dec2bcd((days + 5) % 7 + 1);						//  day 0 is SAT (6)
+	
+		//  year, in cycles of four years starting with a leap year
+	uint8_t  y   = (days / 1461) * 4;
+	uint16_t doy = days % 1461;							//  day of the four year cycle
+	uint8_t  leap = 0;
+	if (doy < 366) leap = 1;
+	else
+	{
+		doy -= 366;
+		y   += 1 + doy / 365;
+		doy %= 365;
+	}
+	
+		//  month and day, search backwards from december
+	uint8_t m = 12;
+	while (doy < pgm_read_word(&days_before_month[m]) + (m > 2 ? leap : 0)) m--;
+	doy -= pgm_read_word(&days_before_month[m]) + (m > 2 ? leap : 0);
+	
+	data[4] = dec2bcd(doy + 1);
+	data[5] = dec2bcd(m);
+	data[6] = dec2bcd(y);
+}
+
 /*
  *     Set the square wave output on PIN7 of the DS1307.
  *
@@ -484,10 +653,7 @@ void DS1307::sqw(SQWM mode) const
 void DS1307::halt()
 {
 	_clkh = 0x01;
-	unsigned char temp_data;
-	
-	read_register(0x00, &temp_data);	
-	write_register(0x00, temp_data | 0x80);
+	modify_register(0x00, 0x00, 0x80);
 }
 
 /*
@@ -496,10 +662,177 @@ void DS1307::halt()
 void DS1307::start()
 {
 	_clkh = 0x00;
-	unsigned char temp_data;
+	modify_register(0x00, 0x80, 0x00);
+}
+
+/*
+ *     Enable the 1Hz square wave and count the time in software.
+ *
+ *     \param sync_interval    Seconds between reads of the DS1307, 1 - 65535.
+ */
+void DS1307::keep_time(uint16_t sync_interval)
+{
+	if (sync_interval == 0) sync_interval = 1;
 	
-	read_register(0x00, &temp_data);	
-	write_register(0x00, temp_data & 0x7F);
+	update();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_ticks = 0;
+	}
+	_since_sync = 0;
+	_tick_timer = false;
+	_sync_interval = sync_interval;
+	sqw(SQW1HZ);
+}
+
+/*
+ *     Count one second. This is safe to call from an interrupt, the time is
+ *     only changed in poll().
+ */
+void DS1307::tick()
+{
+	_ticks++;
+}
+
+/*
+ *     Apply the seconds counted by tick(), and read the DS1307 when the sync
+ *     interval has passed, or when the ticks have stopped.
+ *
+ *     \param now    The current time in milliseconds.
+ *     \return       True if the time changed since the last call.
+ */
+bool DS1307::poll(uint16_t now)
+{
+	uint8_t ticks;
+	
+	if (!_sync_interval)
+	{
+		update();
+		return true;
+	}
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ticks  = _ticks;
+		_ticks = 0;
+	}
+	
+		//  without ticks for a while, read the time instead of counting it
+	if (!_tick_timer)
+	{
+		_last_tick  = now;
+		_tick_timer = true;
+	}
+	if (!ticks)
+	{
+		if ((uint16_t)(now - _last_tick) < DS1307_TICK_TIMEOUT) return false;
+		update();
+		_since_sync = 0;
+		return true;
+	}
+	_last_tick = now;
+	
+	_since_sync += ticks;
+	if (_since_sync >= _sync_interval)
+	{
+		update();
+		_since_sync = 0;
+	}
+	else while (ticks--) advance_second();
+	return true;
+}
+
+/*
+ *     Private function to advance the member fields by one second, rolling 
+ *     over minutes, hours, days, months and years.
+ */
+void DS1307::advance_second()
+{
+	if (++_sec < 60) return;
+	_sec = 0;
+	if (++_min < 60) return;
+	_min = 0;
+	
+	_hr++;
+	if (_mode == DSMODE12)
+	{
+		if (_hr == 13) _hr = 1;
+		if (_hr != 12) return;
+		_mi = (DSAMPM)(_mi ^ 0x01);					//  11 -> 12 toggles AM/PM ...
+		if (_mi == PM) return;						//  ... and a new day starts at 12 AM
+	}
+	else
+	{
+		if (_hr < 24) return;
+		_hr = 0;
+	}
+	
+		//  next day
+	_dow = (_dow % 7) + 1;
+	if (is_valid_date(_yr, _mth, ++_day)) return;
+	_day = 1;
+	if (++_mth <= 12) return;
+	_mth = 1;
+	_yr  = (_yr + 1) % 100;
+}
+
+/*
+ *     Read consecutive registers in one transaction.
+ *
+ *     \param  reg     The first register to read.
+ *     \param *data    Pointer to an array that will receive the data.
+ *     \param  n       Number of registers to read.
+ *     \return         True if successful, false if not.
+ */
+bool DS1307::read_registers(uint8_t reg, uint8_t *data, uint8_t n) const
+{
+	bool success = twi_open(DS1307_I2C_ADDRESS) && twi_read_str(reg, data, n);
+	twi_close();
+	return success;
+}
+
+/*
+ *     Write consecutive registers in one transaction. The DS1307 needs no
+ *     time to complete the write.
+ *
+ *     \param  reg     The first register to write to.
+ *     \param *data    Pointer to the data to write.
+ *     \param  n       Number of registers to write.
+ *     \return         True if successful, false if not.
+ */
+bool DS1307::write_registers(uint8_t reg, const uint8_t *data, uint8_t n) const
+{
+	bool success = twi_open(DS1307_I2C_ADDRESS) && twi_write_ch(reg) && twi_write_str(data, n);
+	twi_close();
+	return success;
+}
+
+/*
+ *     Read from the battery backed RAM.
+ *
+ *     \param addr     Address of the first byte, 0 - 55.
+ *     \param *data    Buffer for the data read.
+ *     \param n        Number of bytes, 1 - 56.
+ *     \return         False if the range is outside the RAM or the DS1307 did not respond.
+ */
+bool DS1307::read_nvram(uint8_t addr, uint8_t *data, uint8_t n) const
+{
+	if (n == 0 || addr + n > DS1307_NVRAM_SIZE) return false;
+	return read_registers(0x08 + addr, data, n);
+}
+
+/*
+ *     Write to the battery backed RAM.
+ *
+ *     \param addr     Address of the first byte, 0 - 55.
+ *     \param *data    Data to be written.
+ *     \param n        Number of bytes, 1 - 56.
+ *     \return         False if the range is outside the RAM or the DS1307 did not respond.
+ */
+bool DS1307::write_nvram(uint8_t addr, const uint8_t *data, uint8_t n) const
+{
+	if (n == 0 || addr + n > DS1307_NVRAM_SIZE) return false;
+	return write_registers(0x08 + addr, data, n);
 }
 
 /*
@@ -513,7 +846,6 @@ void DS1307::read_register(unsigned char reg, unsigned char *data) const
 	twi_open(DS1307_I2C_ADDRESS);
 	twi_read_ch(reg, data);
 	twi_close();	
-	_delay_ms(50);
 }
 
 /*
@@ -528,5 +860,27 @@ void DS1307::write_register(unsigned char reg, unsigned char data) const
 	twi_write_ch(reg);
 	twi_write_ch(data);
 	twi_close();
-	_delay_ms(50);
+}
+
+/*
+ *     Private function to change some bits of a DS1307 register. The register
+ *     is read, and written back after a repeated start, without releasing the bus.
+ *
+ *     \param reg     The register to change.
+ *     \param clear   The bits to clear.
+ *     \param set     The bits to set.
+ *     \return        True if successful, false if not.
+ */
+bool DS1307::modify_register(uint8_t reg, uint8_t clear, uint8_t set) const
+{
+	unsigned char data;
+	bool success = twi_open(DS1307_I2C_ADDRESS) && twi_read_ch(reg, &data);
+	
+	if (success)
+	{
+		data = (data & ~clear) | set;
+		success = twi_open(DS1307_I2C_ADDRESS) && twi_write_ch(reg) && twi_write_ch(data);	//  repeated start
+	}
+	twi_close();
+	return success;
 }
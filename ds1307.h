@@ -8,11 +8,11 @@
  * Purpose:	To communicate with a DS1307 Real Time Clock via a TWI interface. 
  *
  * Dependencies:
- *          util/delay.h: After transmitting data to the DS1307, the program will wait for 
- *                        it to process the data.
  *          stdint.h      This library uses data types defined in this header. stdint.h is
  *                        part of the C standard library.
  *          twi.h:        This library is designed to work with a TWI interface.
+ *          avr/pgmspace.h:
+ *                        The calendar tables are stored in program memory.
  *
  * License:
  * 
@@ -39,6 +39,12 @@
 
 #include <stdint.h>
 
+#ifndef DS1307_TICK_TIMEOUT
+#define DS1307_TICK_TIMEOUT 2000						//  ms without a square wave tick before poll() reads the DS1307
+#endif
+
+#define DS1307_NVRAM_SIZE 56							//  battery backed RAM, registers 0x08 - 0x3F
+
 enum SQWM   : uint8_t {SQWOFF = 0x00, SQW1HZ = 0x10, SQW4K = 0x11, SQW8K = 0x12, SQW32K = 0x13};
 enum DOW    : uint8_t {MON = 1, TUE = 2, WED = 3, THU = 4, FRI = 5, SAT = 6, SUN = 7};
 enum DSMODE : uint8_t {DSMODE24 = 0x00, DSMODE12 = 0x01};
@@ -89,6 +95,67 @@ class DS1307
 		void halt();
 		void start();
 		
+		/*
+		 *     Functions to read or write n consecutive registers, starting with
+		 *     register reg, in one transaction.
+		 */
+		bool read_registers(uint8_t reg, uint8_t *data, uint8_t n) const;
+		bool write_registers(uint8_t reg, const uint8_t *data, uint8_t n) const;
+		
+		/*
+		 *     Functions to read or write n bytes of the battery backed RAM, starting 
+		 *     with byte addr (0 - 55), in one transaction. The contents are kept as long 
+		 *     as the backup battery lasts. Both return false if the range doesn't fit.
+		 */
+		bool read_nvram(uint8_t addr, uint8_t *data, uint8_t n) const;
+		bool write_nvram(uint8_t addr, const uint8_t *data, uint8_t n) const;
+		
+		/*
+		 *     Timekeeping from the square wave. keep_time() enables the 1Hz square wave
+		 *     and reads the time once. After that, the time is counted in software: tick() 
+		 *     must be called on each falling edge of the square wave, typically from an 
+		 *     external interrupt, and poll() replaces update() in the main loop. poll() 
+		 *     only reads the DS1307 once every sync_interval seconds, to correct any missed 
+		 *     ticks.
+		 *
+		 *     Example, with SQW/OUT connected to INT1 (PD3):
+		 *     PORTD |= 0x08;                       //  SQW/OUT is open drain, enable pull-up
+		 *     EICRA |= 0x08;                       //  falling edge on INT1
+		 *     EIMSK |= 0x02;
+		 *     ISR(INT1_vect) {clock.tick();}
+		 *
+		 *     now is the current time in milliseconds, from any clock that counts
+		 *     milliseconds, f.ex timer_millis(). It may wrap around. If no tick has
+		 *     arrived for DS1307_TICK_TIMEOUT milliseconds, f.ex because SQW/OUT is
+		 *     not connected, poll() falls back to calling update() until the ticks
+		 *     return, so the time never stops.
+		 *
+		 *     Note:  poll() returns true if the time changed since the last call.
+		 *            Without keep_time(), poll() calls update() and returns true.
+		 */
+		void keep_time(uint16_t sync_interval = 3600);
+		void tick();
+		bool poll(uint16_t now);
+		
+		/*
+		 *     Date and time as a single number, the seconds since 01.01.2000 00:00:00. 
+		 *     The range of the DS1307 is 2000 - 2099, so this always fits in 32 bits, and 
+		 *     the difference of two timestamps is the number of seconds between them.
+		 *
+		 *     get_epoch() and set_epoch() use the member fields, no data is transferred.
+		 *     set_epoch() also sets the day of week. read_epoch() reads the time directly 
+		 *     from the DS1307, without changing the member fields.
+		 *
+		 *     The static functions convert between a timestamp and the 7 time and calendar 
+		 *     registers 0x00 - 0x06 as read by read_registers().
+		 */
+		uint32_t get_epoch() const;
+		bool set_epoch(uint32_t t);
+		bool read_epoch(uint32_t &t) const;
+		
+		static uint32_t registers_to_epoch(const uint8_t *data);
+		static void epoch_to_registers(uint32_t t, uint8_t *data, DSMODE mode);
+		
 	private:
 		/*
 		 *     Functions that read or write a single byte to DS1307.
@@ -96,6 +163,10 @@ class DS1307
 		 */
 		void read_register(unsigned char reg, unsigned char *data) const;
 		void write_register(unsigned char reg, unsigned char data) const;
+		bool modify_register(uint8_t reg, uint8_t clear, uint8_t set) const;
+		void advance_second();							//  count one second in software
+		void load(const uint8_t *data);						//  registers 0x00 - 0x06 to member fields
+		void store(uint8_t *data) const;					//  member fields to registers 0x00 - 0x06
 		
 		/*
 		 *     Member fields
@@ -108,4 +179,10 @@ class DS1307
 		
 		DSAMPM _mi;								//  meridien indicator (AM/PM)
 		DSMODE _mode;								//  12 hour or 24 hour mode (24 is default)
+		
+		volatile uint8_t _ticks;						//  seconds counted by tick(), not yet applied
+		uint16_t _sync_interval;						//  seconds between reads in keep_time mode, 0 if off
+		uint16_t _since_sync;							//  seconds since the last read
+		uint16_t _last_tick;							//  time of the last poll() that found a tick, in ms
+		bool     _tick_timer;							//  true when _last_tick is set
 };
@@ -9,14 +9,15 @@
  *
  * Limitations:
  *
- *          This code is mainly limited by the capabilities of onewire.c which does not support
- *          the SEARCH ROM command.
+ *          This code is mainly limited by the capabilities of onewire.c. Use owi_search_rom
+ *          to find the ROM codes of the devices on the bus.
  *
  * Dependencies:
  *
  *          util/delay.h: The function ds18b20_read_temp uses this to wait for the ds18b20
  *                        device while it converts temperature.
- *          onewire.h:    The ds18b20 is a one wire device.
+ *          onewire.h:    The ds18b20 is a one wire device. With OWI_MULTI_BUS, the functions
+ *                        work on the bus selected with owi_select_bus.
  *
  * License:
  *
@@ -52,6 +53,7 @@
 
 #include <util/delay.h>
 #include "onewire.h"
+#include "prof.h"
 #include "ds18b20.h"
 
 
@@ -62,118 +64,219 @@
 #define CMD_CONVERT_TEMP		0x44
 #define CMD_READ_SCRATCHPAD		0xBE
 #define CMD_WRITE_SCRATCHPAD		0x4E
+#define CMD_COPY_SCRATCHPAD		0x48
+#define CMD_RECALL_E2			0xB8
 
 
 
 /*
- *     An array of 3 chars used to write to the DS18B20 scratchpad.
- *     Keep in mind that even though owi_write_byte requires unsigned 
- *     char as parameter, this is, in the end, just ones and zeros.
- *     The initial numbers represent Th = 125 or 0x7D in hexadecimal, 
- *     Tl = -55 or 0xC9 in hexadecimal two's complement representation, 
- *     and 12 bit resolution meaning 0.0625 degrees resolution.
+ *     The number of times a validated read of the scratchpad is repeated
+ *     if the CRC is wrong, and the read mode used by ds18b20_read_temp.
  */
-static unsigned char _ds18b20_config[3] = {0x7D, 0xC9, DS18B20_12BIT};
+#ifndef DS18B20_RETRIES
+#define DS18B20_RETRIES			2
+#endif
+
+#ifndef DS18B20_READ_MODE
+#define DS18B20_READ_MODE		DS18B20_VALIDATED
+#endif
+
+
 
 /*
- *     An array of 9 unsigned chars to hold one byte used as a boolean, byte 0, 
- *     and a 64 bit ROM code that uniquely identifies a device, byte 1 - 8.
+ *     The state kept for each bus, so the buses can be used independently.
+ *
+ *     address     One byte used as a boolean, byte 0, and the 64 bit ROM code set 
+ *                 with ds18b20_set_rom, byte 1 - 8.
+ *     resolution  The resolution last set with ds18b20_set_resolution, or 0 if it
+ *                 was never set, which is the power-up default of 12 bits.
+ *     deadline    When the conversion started on the bus is complete, and 
+ *     converting  whether one is in progress.
  */
-static unsigned char _ds18b20_address[9] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+struct ds18b20_bus
+{
+	uint8_t  address[9];
+	uint8_t  resolution;
+	uint16_t deadline;
+	uint8_t  converting;
+};
+
+static struct ds18b20_bus _ds18b20_buses[OWI_BUS_COUNT];
 
 /*
- *     An array of 5 unsigned chars to hold the contents of the DS18B20 scratchpad.
- *     The contents are stored in the order: [0] Temp LSB, [1] Temp MSB, [2] Th, [3] Tl, [4] Config.
+ *     The number of bytes ds18b20_read_temp reads, from enumeration DS18B20_READ_MODE.
  */
-static unsigned char _ds18b20_scratchpad[5] = {0x00, 0x00, 0x00, 0x00, 0x00};
+static uint8_t _ds18b20_read_mode = DS18B20_READ_MODE;
 
 /*
- *     This writes the contents of _ds18b20_config to the scratchpad.
+ *     Maximum conversion times in milliseconds for 9, 10, 11 and 12 bit resolution,
+ *     rounded up.
  */
-static int ds18b20_write_scratchpad()
-{	
-	if (!owi_detect_presence()) return 0;						//  Check whether ds18b20 is online.
-	
+static const uint16_t _ds18b20_conversion_time[4] = {94, 188, 375, 750};
+
+/*
+ *     The state of the bus selected with owi_select_bus.
+ */
+static struct ds18b20_bus *ds18b20_bus()
+{
+#ifdef OWI_MULTI_BUS
+	return &_ds18b20_buses[owi_get_bus()];
+#else
+	return &_ds18b20_buses[0];
+#endif
+}
+
+/*
+ *     The ROM code set with ds18b20_set_rom, or 0 if none is set.
+ */
+static const uint8_t *ds18b20_selected_rom()
+{
+	struct ds18b20_bus *bus = ds18b20_bus();
 	
-		//  skip or match ROM and send command to write scratchpad
-	if (_ds18b20_address[0]) owi_match_rom(&_ds18b20_address[1]);
-	else owi_skip_rom();								//  Send skip ROM command.
-	owi_write_byte(CMD_WRITE_SCRATCHPAD);						//  Send write scratchpad command.
+	return bus->address[0] ? &bus->address[1] : 0;
+}
+
+/*
+ *     The resolution last set with ds18b20_set_resolution.
+ */
+static uint8_t ds18b20_resolution()
+{
+	uint8_t res = ds18b20_bus()->resolution;
 	
-	for (int i = 0; i < 3; i++)
-	{
-		owi_write_byte(_ds18b20_config[i]);					//  Write data.
-	}
-	return 1;
+	return res ? res : (uint8_t)DS18B20_12BIT;
 }
 
 /*
- *     This reads the first 5 bytes of the scratchpad and stores
- *     in _ds18b20_scratchpad
+ *     Reset the bus and address a device.
  *
- *     \return     1 if success, 0 if not.
+ *     \param *rom     ROM code of the device, or 0 to address all devices.
+ *     \return         1 if success, 0 if no device is responding.
  */
-static int ds18b20_read_scratchpad()
+static int ds18b20_address_device(const uint8_t *rom)
 {
-		//  send reset pulse and check for presence
 	if (!owi_detect_presence()) return 0;
 	
-		//  skip or match ROM and send command to read scratchpad
-	if (_ds18b20_address[0]) owi_match_rom(&_ds18b20_address[1]);
+	if (rom) owi_match_rom((uint8_t *)rom);
 	else owi_skip_rom();
+	return 1;
+}
+
+/*
+ *     This writes the alarms and the configuration register to the scratchpad.
+ *
+ *     \param *rom     ROM code of the device, or 0 to address all devices.
+ *     \param th      High alarm temperature, two's complement.
+ *     \param tl      Low alarm temperature, two's complement.
+ *     \param config  Configuration register, a value from DS18B20_RESOLUTION.
+ */
+static int ds18b20_write_scratchpad(const uint8_t *rom, uint8_t th, uint8_t tl, uint8_t config)
+{	
+	if (!ds18b20_address_device(rom)) return 0;					//  Check whether ds18b20 is online, skip or match ROM.
+	owi_write_byte(CMD_WRITE_SCRATCHPAD);						//  Send write scratchpad command.
 	
-		//  read scratchpad
-	owi_write_byte(CMD_READ_SCRATCHPAD);
-	for (int i = 0; i < 5; i++) _ds18b20_scratchpad[i] = owi_read_byte();
-	
-		//  terminate data transfer and return
-	owi_detect_presence();	
+	owi_write_byte(th);								//  Write data.
+	owi_write_byte(tl);
+	owi_write_byte(config);
 	return 1;
+}
+
+/*
+ *     This reads the first length bytes of the scratchpad and stores them
+ *     in scratchpad. If all 9 bytes are read, the CRC is checked and the
+ *     read is repeated up to DS18B20_RETRIES times if it is wrong.
+ *     If fewer bytes are read, the master ends the transfer with a reset.
+ *
+ *     \param *rom         ROM code of the device, or 0 to address all devices.
+ *     \param length       DS18B20_FAST (2 bytes) or DS18B20_VALIDATED (9 bytes).
+ *     \param *scratchpad  9 bytes that receive the scratchpad, in the order: [0] Temp LSB, 
+ *                         [1] Temp MSB, [2] Th, [3] Tl, [4] Config, [5 - 7] reserved, [8] CRC.
+ *     \return             1 if success, 0 if not.
+ */
+static int ds18b20_read_scratchpad(const uint8_t *rom, uint8_t length, uint8_t *scratchpad)
+{
+	for (uint8_t attempt = 0; attempt <= DS18B20_RETRIES; attempt++)
+	{
+			//  send reset pulse, check for presence, skip or match ROM
+		if (!ds18b20_address_device(rom)) return 0;
+	
+			//  read scratchpad
+		owi_write_byte(CMD_READ_SCRATCHPAD);
+		for (uint8_t i = 0; i < length; i++) scratchpad[i] = owi_read_byte();
+		
+			//  terminate data transfer and return
+		if (length < 9)
+		{
+			owi_detect_presence();
+			return 1;
+		}
+		
+			//  A shorted line reads all zeros, which has a valid CRC, but the lower 5 bits of the
+			//  configuration register always read 1.
+		if (owi_crc8(scratchpad, 9) == 0x00 && (scratchpad[4] & 0x9F) == 0x1F) return 1;
+	}
+	return 0;
 } 
 
 
 /*
- *     This sets each byte of _ds18b20_address to zero.
+ *     This copies the scratchpad to EEPROM and waits for the copy to complete.
+ *
+ *     \param *rom     ROM code of the device, or 0 to address all devices.
+ *     \return         1 if success, 0 if no device is responding.
+ *
+ *     Note:  The line is left high while waiting, which also powers parasite
+ *            powered devices through the pull-up.
+ */
+static int ds18b20_copy(const uint8_t *rom)
+{
+	if (!ds18b20_address_device(rom)) return 0;
+	owi_write_byte(CMD_COPY_SCRATCHPAD);
+	_delay_ms(10);								//  EEPROM write time
+	return 1;
+}
+
+/*
+ *     This copies EEPROM to the scratchpad and waits for the recall to complete.
+ *     The device sends 0 while the recall is in progress and 1 when it is done.
+ *
+ *     \param *rom     ROM code of the device, or 0 to address all devices.
+ *     \return         1 if success, 0 if no device is responding.
+ */
+static int ds18b20_recall(const uint8_t *rom)
+{
+	if (!ds18b20_address_device(rom)) return 0;
+	owi_write_byte(CMD_RECALL_E2);
+	for (uint8_t i = 0; i < 10 && owi_is_busy(); i++) _delay_ms(1);
+	return 1;
+}
+
+/*
+ *     This sets each byte of the address of the selected bus to zero.
  */
 static void ds18b20_reset_rom()
 {
-	for (int i = 0; i < 9; i++) _ds18b20_address[i] = 0x00;
+	struct ds18b20_bus *bus = ds18b20_bus();
+	
+	for (int i = 0; i < 9; i++) bus->address[i] = 0x00;
 }
 
 /*
- *     This combines the information in lsb and msb into a floating point number
- *     according to the temperature register format specified in the DS18B20 datasheet.
+ *     This combines the information in lsb and msb into a 16 bit two's complement
+ *     number in 1/16 degrees, according to the temperature register format specified 
+ *     in the DS18B20 datasheet. At lower resolutions, the least significant bits are 
+ *     undefined and are cleared.
  *
- *     \param lsb     The least significant byte of the 16 bit extended two's complement 
- *                    number in the temperature register.
+ *     \param lsb     The least significant byte of the temperature register.
  *     \param msb     The most significant byte.
- *     \return        A floating point number representing the temperature reading.
+ *     \param config  The configuration register, which holds the resolution.
+ *     \return        The temperature in 1/16 degrees.
  */     
-static float ds18b20_convert(unsigned char lsb, unsigned char msb)
+static int16_t ds18b20_convert(unsigned char lsb, unsigned char msb, unsigned char config)
 {
-	float temp = 0.0, factor = 0.5;
-	
-		//  Isolate integral part by combining right nybble of msb with left nybble of lsb.
-	int8_t integral = (msb << 4) | (lsb >> 4);
-	
-		//  Isolate binary decimal part, that is right nybble of lsb.
-	uint8_t decimal = (lsb & 0x0F);
+		//  Number of undefined bits, 0 at 12 bit resolution, up to 3 at 9 bit resolution.
+	uint8_t undefined = 3 - ((config & 0x60) >> 5);
 	
-		//  Determine position of last active bit in decimal part. This is the resolution. 
-	uint8_t n = 0x08 >> ((_ds18b20_config[2] & 0x60) >> 5);
-	
-		//  Convert from bicimal to decimal.
-	for (uint8_t mask = 0x08; mask >= n; mask >>= 1)
-	{
-		temp   += factor * ((decimal & mask) != 0);		
-		factor *= 0.5;
-	}
-	
-		//  If integral part is negative, so must decimal part.
-	if (integral < 0) temp *= -1.0;
-	temp += integral;
-	
-	return temp;
+	return (int16_t)(((uint16_t)msb << 8) | lsb) & ~((1 << undefined) - 1);
 }
 
 
@@ -196,37 +299,103 @@ int ds18b20_start_conversion()
 
 
 
-int ds18b20_read_temp(float *temp)
-{		
-	unsigned char lsb = 0x00;
-	unsigned char msb = 0x00;
+int ds18b20_start_conversion_at(uint16_t now)
+{
+	struct ds18b20_bus *bus = ds18b20_bus();
 	
-	while(owi_is_busy()) _delay_ms(5);					//  temp. conversion takes at least 93.75ms
+	if (!ds18b20_start_conversion()) return 0;
 	
-	ds18b20_read_scratchpad();
+	bus->deadline   = now + ds18b20_conversion_time(ds18b20_resolution());
+	bus->converting = 1;
+	return 1;
+}
+
+
+
+int ds18b20_conversion_done(uint16_t now)
+{
+	struct ds18b20_bus *bus = ds18b20_bus();
 	
-		//  get LSB and MSB from scratchpad	
-	lsb = _ds18b20_scratchpad[0];
-	msb = _ds18b20_scratchpad[1];
+		//  the difference is negative until the deadline, even if the clock wraps
+	if (bus->converting && (int16_t)(now - bus->deadline) >= 0) bus->converting = 0;
+	return !bus->converting;
+}
+
+
+
+uint16_t ds18b20_conversion_time(const int res)
+{
+	return _ds18b20_conversion_time[(res & 0x60) >> 5];
+}
+
+
+
+int ds18b20_read_temp_fixed(int16_t *temp)
+{
+	uint8_t scratchpad[9];
+	int     success;
 	
-	*temp = ds18b20_convert(lsb, msb);
+	while(owi_is_busy()) _delay_ms(5);					//  temp. conversion takes at least 93.75ms
+	
+	PROF_START(t);
+	success = ds18b20_read_scratchpad(ds18b20_selected_rom(), _ds18b20_read_mode, scratchpad);
 	ds18b20_reset_rom();
+	PROF_STOP(PROF_DS18B20, t);
+	if (!success)
+	{
+		PROF_ERROR(PROF_DS18B20);
+		return 0;
+	}
+	
+		//  combine LSB and MSB from scratchpad. In fast mode, the configuration register
+		//  is not read, so assume the resolution last set.
+	*temp = ds18b20_convert(scratchpad[0], scratchpad[1], 
+	                        (_ds18b20_read_mode == DS18B20_VALIDATED) ? scratchpad[4] : ds18b20_resolution());
+	return 1;
+}
+
+
+
+int ds18b20_read_temp(float *temp)
+{
+	int16_t raw;
+	
+	if (!ds18b20_read_temp_fixed(&raw)) return 0;	
+	*temp = raw / 16.0;
 	return 1;
 }
 
 
 
+int16_t ds18b20_to_tenths(int16_t temp)
+{
+		//  round to nearest, away from zero at halves
+	if (temp < 0) return -((-temp * 10 + 8) / 16);
+	return (temp * 10 + 8) / 16;
+}
+
+
+
+void ds18b20_set_read_mode(const int mode)
+{
+	_ds18b20_read_mode = (mode == DS18B20_FAST) ? DS18B20_FAST : DS18B20_VALIDATED;
+}
+
+
+
 int ds18b20_set_resolution(const int res)
 {			
-	ds18b20_read_scratchpad();
+	uint8_t scratchpad[9];
 	
-		//  don't change the alarms
-	_ds18b20_config[0] = _ds18b20_scratchpad[2];
-	_ds18b20_config[1] = _ds18b20_scratchpad[3];
-	_ds18b20_config[2] = res;	
+	if (!ds18b20_read_scratchpad(ds18b20_selected_rom(), DS18B20_VALIDATED, scratchpad))
+	{
+		ds18b20_reset_rom();
+		return 0;
+	}
+	ds18b20_bus()->resolution = res;
 	
-		//  write to scratchpad and reset address.
-	if (!ds18b20_write_scratchpad()) return 0;
+		//  don't change the alarms, write to scratchpad and reset address.
+	if (!ds18b20_write_scratchpad(ds18b20_selected_rom(), scratchpad[2], scratchpad[3], res)) return 0;
 	ds18b20_reset_rom();
 	
 	return 1;
@@ -236,6 +405,8 @@ int ds18b20_set_resolution(const int res)
 
 int ds18b20_set_alarms(int8_t tl, int8_t th)
 {
+	uint8_t scratchpad[9];
+	
 		/*
 		 *     tl must be higher than -55
 		 *     tl must be lower than th
@@ -244,15 +415,15 @@ int ds18b20_set_alarms(int8_t tl, int8_t th)
 		 */
 	if (tl < -55 || tl > th || th > 125) return 0;	
 	
-	ds18b20_read_scratchpad();	
-	
-		//  don't change the configuration register
-	_ds18b20_config[0] = th;
-	_ds18b20_config[1] = tl;
-	_ds18b20_config[2] = _ds18b20_scratchpad[4];	
+	if (!ds18b20_read_scratchpad(ds18b20_selected_rom(), DS18B20_VALIDATED, scratchpad))
+	{
+		ds18b20_reset_rom();
+		return 0;
+	}
+	ds18b20_bus()->resolution = scratchpad[4];
 	
-		//  write to scratchpad and reset address.
-	if (!ds18b20_write_scratchpad()) return 0;
+		//  don't change the configuration register, write to scratchpad and reset address.
+	if (!ds18b20_write_scratchpad(ds18b20_selected_rom(), th, tl, scratchpad[4])) return 0;
 	ds18b20_reset_rom();
 	
 	return 1;
@@ -273,8 +444,10 @@ int ds18b20_read_rom(uint8_t *romcode_array)
 
 void ds18b20_set_rom(uint8_t *romcode_array)
 {
-	_ds18b20_address[0] = 0x01;
-	for (int i = 0; i < 8; i++) _ds18b20_address[i + 1] = romcode_array[i];	
+	struct ds18b20_bus *bus = ds18b20_bus();
+	
+	bus->address[0] = 0x01;
+	for (int i = 0; i < 8; i++) bus->address[i + 1] = romcode_array[i];	
 }
 
 
@@ -283,3 +456,205 @@ int ds18b20_check_alarm()
 {		
 	return owi_alarm_search();
 }
+
+
+
+int ds18b20_copy_scratchpad()
+{
+	int success = ds18b20_copy(ds18b20_selected_rom());
+	
+	ds18b20_reset_rom();
+	return success;
+}
+
+
+
+int ds18b20_recall_e2()
+{
+	int success = ds18b20_recall(ds18b20_selected_rom());
+	
+	ds18b20_reset_rom();
+	return success;
+}
+
+
+
+/*
+ *     The functions below work on a device handle.
+ */
+/*
+ *     Read the configuration of a device into its handle. Nothing is known
+ *     about EEPROM, so only SYNCED is set.
+ */
+static int ds18b20_device_load(struct ds18b20_device *device)
+{
+	uint8_t scratchpad[9];
+	
+	if (!ds18b20_read_scratchpad(device->rom, DS18B20_VALIDATED, scratchpad))
+	{
+		device->status = DS18B20_ERROR;
+		return 0;
+	}
+	
+	device->th     = scratchpad[2];
+	device->tl     = scratchpad[3];
+	device->config = scratchpad[4];
+	device->flags  = DS18B20_SYNCED;
+	return 1;
+}
+
+
+
+int ds18b20_device_init(struct ds18b20_device *device, const uint8_t *romcode_array)
+{
+	for (int i = 0; i < 8; i++) device->rom[i] = romcode_array[i];
+	device->th     = 0x7D;							//  power-up defaults, until read
+	device->tl     = 0xC9;
+	device->config = DS18B20_12BIT;
+	device->temp   = 0;
+	device->status = DS18B20_UNKNOWN;
+	device->flags  = 0;
+	
+		//  the scratchpad may hold unsaved changes if only the MCU was reset,
+		//  so restore it from EEPROM to know that the two are the same
+	return ds18b20_device_recall(device);
+}
+
+
+
+int ds18b20_find(struct ds18b20_device *devices, int capacity)
+{
+	uint8_t rom[8];
+	int     count = 0;
+	
+	for (int found = owi_search_first(rom); found && count < capacity; found = owi_search_next(rom))
+	{
+		if (rom[0] != DS18B20_FAMILY_CODE) continue;				//  some other kind of device
+		ds18b20_device_init(&devices[count++], rom);
+	}
+	return count;
+}
+
+
+
+/*
+ *     Write the configuration cached in device to its scratchpad.
+ */
+static int ds18b20_device_write(struct ds18b20_device *device)
+{
+	if (!ds18b20_write_scratchpad(device->rom, device->th, device->tl, device->config))
+	{
+		device->flags &= ~DS18B20_SYNCED;
+		device->status = DS18B20_ERROR;
+		return 0;
+	}
+	device->flags = DS18B20_SYNCED;						//  EEPROM may no longer have the same, so SAVED is cleared
+	return 1;
+}
+
+
+
+int ds18b20_device_set_resolution(struct ds18b20_device *device, const int res)
+{
+	if ((device->flags & DS18B20_SYNCED) && device->config == res) return 1;
+	
+	device->config = res;
+	return ds18b20_device_write(device);
+}
+
+
+
+int ds18b20_device_set_alarms(struct ds18b20_device *device, int8_t tl, int8_t th)
+{
+	if (tl < -55 || tl > th || th > 125) return 0;
+	if ((device->flags & DS18B20_SYNCED) && device->th == (uint8_t)th && device->tl == (uint8_t)tl) return 1;
+	
+	device->th = th;
+	device->tl = tl;
+	return ds18b20_device_write(device);
+}
+
+
+
+int ds18b20_device_save(struct ds18b20_device *device)
+{
+	if ((device->flags & DS18B20_SAVED) && (device->flags & DS18B20_SYNCED)) return 1;
+	if (!(device->flags & DS18B20_SYNCED) && !ds18b20_device_write(device)) return 0;
+	
+	if (!ds18b20_copy(device->rom))
+	{
+		device->status = DS18B20_ERROR;
+		return 0;
+	}
+	device->flags |= DS18B20_SAVED;
+	return 1;
+}
+
+
+
+int ds18b20_device_recall(struct ds18b20_device *device)
+{
+	if (!ds18b20_recall(device->rom))
+	{
+		device->status = DS18B20_ERROR;
+		return 0;
+	}
+	if (!ds18b20_device_load(device)) return 0;
+	
+	device->flags |= DS18B20_SAVED;						//  the scratchpad was just read from EEPROM
+	return 1;
+}
+
+
+
+int ds18b20_device_read(struct ds18b20_device *device)
+{
+	uint8_t scratchpad[9];
+	int     success;
+	
+	PROF_START(t);
+	success = ds18b20_read_scratchpad(device->rom, _ds18b20_read_mode, scratchpad);
+	PROF_STOP(PROF_DS18B20, t);
+	if (!success)
+	{
+		PROF_ERROR(PROF_DS18B20);
+		device->status = DS18B20_ERROR;
+		return 0;
+	}
+	
+		//  In fast mode, the configuration register is not read, so use the cached one.
+	if (_ds18b20_read_mode == DS18B20_VALIDATED) device->config = scratchpad[4];
+	device->temp   = ds18b20_convert(scratchpad[0], scratchpad[1], device->config);
+	device->status = DS18B20_OK;
+	return 1;
+}
+
+
+
+int ds18b20_read_all(struct ds18b20_device *devices, int n)
+{
+	int count = 0;
+	
+	for (int i = 0; i < n; i++) count += ds18b20_device_read(&devices[i]);
+	return count;
+}
+
+
+
+int ds18b20_start_conversion_all(const struct ds18b20_device *devices, int n, uint16_t now)
+{
+	struct ds18b20_bus *bus  = ds18b20_bus();
+	uint16_t            wait = 0;
+	
+	if (!ds18b20_start_conversion()) return 0;
+	
+		//  wait for the slowest device
+	for (int i = 0; i < n; i++)
+	{
+		uint16_t t = ds18b20_conversion_time(devices[i].config);
+		if (t > wait) wait = t;
+	}
+	bus->deadline   = now + wait;
+	bus->converting = 1;
+	return 1;
+}
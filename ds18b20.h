@@ -9,14 +9,34 @@
  *	
  * Limitations:
  *
- *          This code is mainly limited by the capabilities of onewire.c which does not support 
- *          the SEARCH ROM command.
+ *          This code is mainly limited by the capabilities of onewire.c. Use owi_search_rom
+ *          to find the ROM codes of the devices on the bus.
  *
  * Dependencies:
  *
  *          util/delay.h: The function ds18b20_read_temp uses this to wait for the ds18b20 
  *                        device while it converts temperature.
- *          onewire.h:    The ds18b20 is a one wire device.
+ *          onewire.h:    The ds18b20 is a one wire device. With OWI_MULTI_BUS, the functions
+ *                        work on the bus selected with owi_select_bus.
+ *
+ * State:
+ *
+ *          With OWI_MULTI_BUS, each bus has its own ROM code set with ds18b20_set_rom, 
+ *          resolution last set with ds18b20_set_resolution and conversion in progress, 
+ *          and the functions use those of the bus selected with owi_select_bus. So a 
+ *          conversion can run on every bus at once, and ds18b20_conversion_done tells 
+ *          when the one on the selected bus is complete. Only the read mode set with 
+ *          ds18b20_set_read_mode is shared by all buses. The device handle functions 
+ *          keep the ROM code and configuration of each device in its handle.
+ *
+ *          Example:  for (uint8_t b = 0; b < OWI_BUS_COUNT; b++)
+ *                    {
+ *                        owi_select_bus(b);
+ *                        ds18b20_start_conversion_all(devices[b], n[b], ms);
+ *                    }
+ *                    ...
+ *                    owi_select_bus(b);
+ *                    if (ds18b20_conversion_done(ms)) ds18b20_read_all(devices[b], n[b]);
  *
  * License:
  *
@@ -43,11 +63,38 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 enum DS18B20_RESOLUTION {DS18B20_9BIT = 0x1F, DS18B20_10BIT = 0x3F, DS18B20_11BIT = 0x5F, DS18B20_12BIT = 0x7F};
+enum DS18B20_READ_MODE  {DS18B20_FAST = 2, DS18B20_VALIDATED = 9};
+enum DS18B20_STATUS     {DS18B20_UNKNOWN, DS18B20_OK, DS18B20_ERROR};
+
+#define DS18B20_FAMILY_CODE 0x28
+
+/*
+ *     A handle to one DS18B20 device. The ROM code and a copy of the device's
+ *     configuration are kept here, so the device can be addressed without
+ *     calling ds18b20_set_rom, and configured without reading it first.
+ *
+ *     Note:  Don't change the members directly, use the functions below.
+ */
+struct ds18b20_device
+{
+	uint8_t rom[8];								//  64-bit ROM code
+	uint8_t th;								//  cached high alarm temperature
+	uint8_t tl;								//  cached low alarm temperature
+	uint8_t config;								//  cached configuration register, the resolution
+	int16_t temp;								//  last temperature read, in 1/16 degrees
+	uint8_t status;								//  result of the last operation, DS18B20_STATUS
+	uint8_t flags;								//  DS18B20_SYNCED and DS18B20_SAVED
+};
+
+#define DS18B20_SYNCED  0x01						//  the cached configuration is in the scratchpad
+#define DS18B20_SAVED   0x02						//  the scratchpad configuration is in EEPROM
 	
 /*
  *     check whether DS18B20 is connected.
@@ -68,6 +115,74 @@ int ds18b20_is_connected();
  */
 int ds18b20_start_conversion();
 
+/*
+ *     Initiate a temperature conversion on all devices and remember when it
+ *     will be complete. This returns immediately, use ds18b20_conversion_done
+ *     to find out when the temperatures can be read.
+ *
+ *     \param now       The current time in milliseconds, from any clock that counts
+ *                      milliseconds, f.ex a Timer. It may wrap around.
+ *     \return          1 if successful, 0 if not (only if DS18B20 is not responding)
+ *
+ *     Example:  ds18b20_start_conversion_at(ms);
+ *               ...
+ *               if (ds18b20_conversion_done(ms)) read all devices
+ *
+ *     Note:  The conversion time is given by the resolution last set with 
+ *            ds18b20_set_resolution, or 12 bits if it was never set. If the 
+ *            devices have different resolutions, set the highest last. With
+ *            device handles, use ds18b20_start_conversion_all instead.
+ */
+int ds18b20_start_conversion_at(uint16_t now);
+
+/*
+ *     Check if the conversion started by ds18b20_start_conversion_at or
+ *     ds18b20_start_conversion_all on the selected bus is complete.
+ *
+ *     \param now       The current time in milliseconds, from the same clock.
+ *     \return          1 if complete, or if no conversion was started, 0 if not.
+ */
+int ds18b20_conversion_done(uint16_t now);
+
+/*
+ *     Get the time a temperature conversion takes.
+ *
+ *     \param res       A value from enumeration DS18B20_RESOLUTION.
+ *     \return          Conversion time in milliseconds, 94, 188, 375 or 750.
+ */
+uint16_t ds18b20_conversion_time(const int res);
+
+/*
+ *     Choose how much of the scratchpad the temperature functions read.
+ *
+ *     \param mode      DS18B20_FAST:      Read only the 2 temperature bytes, then 
+ *                                         end the transfer with a reset. Fastest, but 
+ *                                         a corrupt read goes undetected.
+ *                      DS18B20_VALIDATED: Read all 9 bytes and check the CRC. If it
+ *                                         is wrong, the device is read again, up to 
+ *                                         DS18B20_RETRIES times. This is the default.
+ *
+ *     Note:  The default can be changed by defining DS18B20_READ_MODE. Setting the
+ *            resolution and alarms always uses a validated read.
+ *
+ *     Note:  In fast mode, the resolution last set with ds18b20_set_resolution is
+ *            used to clear the undefined bits of the temperature.
+ */
+void ds18b20_set_read_mode(const int mode);
+
+/*
+ *     Reads the DS18B20 scratchpad and combines the two first bytes into a 
+ *     fixed point number in 1/16 degrees. No floating point arithmetic is used.
+ *
+ *     \param *temp     Pointer to int16_t that will receive the temperature.
+ *                      f.ex. 25.0625 degrees is 401 and -10.125 degrees is -162.
+ *     \return          0 if reading failed (DS18B20 is not responding, or the 
+ *                      CRC was wrong in all attempts), 1 if success
+ *
+ *     Note:  At lower resolutions, the undefined least significant bits are 0.
+ */
+int ds18b20_read_temp_fixed(int16_t *temp);
+
 /*
  *     Reads the two first bytes of the DS18B20 scratchpad and combines the two 
  *     bytes into a float. 
@@ -75,9 +190,21 @@ int ds18b20_start_conversion();
  *     \param *temp     Pointer to float that will receive temperature.
  *     \return          0 if reading failed (only if DS18B20 is not responding),
  *                      1 if success
+ *
+ *     Note:  This uses floating point arithmetic, which is slow and takes a lot
+ *            of flash. Use ds18b20_read_temp_fixed if possible.
  */
 int ds18b20_read_temp(float *temp);
 
+/*
+ *     Convert a temperature in 1/16 degrees to 1/10 degrees, rounded to nearest.
+ *     Use with fmt_tenths in format.h for display output.
+ *
+ *     \param temp      Temperature in 1/16 degrees.
+ *     \return          Temperature in 1/10 degrees.
+ */
+int16_t ds18b20_to_tenths(int16_t temp);
+
 /*
  *     Set the temperature resolution from 0.5 degrees to 0.0625 degrees. This 
  *     will significantly affect temperature conversion time from 93.75ms at 
@@ -160,9 +287,135 @@ void ds18b20_set_rom(uint8_t *romcode_array);
  *     Note:  This only detects if an alarm flag was set, it does
  *            not say anything about whether it was triggered by 
  *            comparing the temperature to Tl of Th.
+ *
+ *     Note:  With many devices on the bus, use owi_alarm_search_all from
+ *            onewire.h to find the devices with the alarm flag set, and
+ *            only read those.
  */
 int ds18b20_check_alarm();
 
+/*
+ *     Copy the alarms and configuration from the scratchpad to EEPROM, so they 
+ *     are kept when the device is powered off. This addresses the device set
+ *     with ds18b20_set_rom, or all devices if none is set.
+ *
+ *     \return   1 if success, 0 if failed (only if DS18B20 is not responding)
+ *
+ *     Note:  This takes 10ms, and the EEPROM wears out after about 50000 writes,
+ *            so only do this when the configuration has changed.
+ */
+int ds18b20_copy_scratchpad();
+
+/*
+ *     Copy the alarms and configuration from EEPROM to the scratchpad. This is
+ *     also done automatically at power-up. This addresses the device set with 
+ *     ds18b20_set_rom, or all devices if none is set.
+ *
+ *     \return   1 if success, 0 if failed (only if DS18B20 is not responding)
+ */
+int ds18b20_recall_e2();
+
+
+
+/*
+ *     Initialize a device handle with a ROM code and read the configuration
+ *     of the device into it. The scratchpad is first restored from EEPROM 
+ *     with RECALL E2, so any configuration that was set but not saved before
+ *     a reset of the MCU is discarded.
+ *
+ *     \param *device          Pointer to the handle.
+ *     \param *romcode_array   Pointer to an 8 byte ROM code.
+ *     \return                 1 if success, 0 if the device isn't responding. The
+ *                             handle is still usable, with default configuration.
+ */
+int ds18b20_device_init(struct ds18b20_device *device, const uint8_t *romcode_array);
+
+/*
+ *     Search the bus for DS18B20 devices and initialize a handle for each.
+ *     Other kinds of devices are skipped.
+ *
+ *     \param *devices         Array of handles.
+ *     \param capacity         Number of handles in the array.
+ *     \return                 Number of devices found, at most capacity.
+ */
+int ds18b20_find(struct ds18b20_device *devices, int capacity);
+
+/*
+ *     Set the resolution of a device. See ds18b20_set_resolution. The alarms 
+ *     are taken from the handle, so the device isn't read first. If the device
+ *     already has this resolution, nothing is sent.
+ *
+ *     \return                 1 if success, 0 if the device isn't responding.
+ */
+int ds18b20_device_set_resolution(struct ds18b20_device *device, const int res);
+
+/*
+ *     Set the alarms of a device. See ds18b20_set_alarms. The resolution is
+ *     taken from the handle, so the device isn't read first. If the device
+ *     already has these alarms, nothing is sent.
+ *
+ *     \return                 1 if success, 0 if failed.
+ */
+int ds18b20_device_set_alarms(struct ds18b20_device *device, int8_t tl, int8_t th);
+
+/*
+ *     Make the configuration of a device persistent by copying it to EEPROM.
+ *     If EEPROM already holds the configuration, nothing is sent.
+ *
+ *     \return                 1 if success, 0 if the device isn't responding.
+ *
+ *     Example:  configure at startup, but only write EEPROM the first time
+ *     ds18b20_device_set_resolution(&device, DS18B20_9BIT);
+ *     ds18b20_device_save(&device);
+ */
+int ds18b20_device_save(struct ds18b20_device *device);
+
+/*
+ *     Restore the configuration of a device from EEPROM, and read it into 
+ *     the handle.
+ *
+ *     \return                 1 if success, 0 if the device isn't responding.
+ */
+int ds18b20_device_recall(struct ds18b20_device *device);
+
+/*
+ *     Read the temperature of a device into device->temp, in 1/16 degrees.
+ *     The read mode set with ds18b20_set_read_mode is used.
+ *
+ *     \return                 1 if success, 0 if not. device->status tells the same.
+ *
+ *     Note:  This doesn't wait for a conversion, use ds18b20_start_conversion_at 
+ *            and ds18b20_conversion_done first.
+ */
+int ds18b20_device_read(struct ds18b20_device *device);
+
+/*
+ *     Read the temperatures of all devices in an array.
+ *
+ *     \param *devices         Array of handles.
+ *     \param n                Number of handles in the array.
+ *     \return                 Number of devices read successfully. Check the status
+ *                             of each device to find out which failed.
+ */
+int ds18b20_read_all(struct ds18b20_device *devices, int n);
+
+/*
+ *     Initiate a temperature conversion on all devices on the bus, and remember 
+ *     when it will be complete, like ds18b20_start_conversion_at. The conversion 
+ *     time is given by the highest resolution in the handles, so the devices can 
+ *     have different resolutions.
+ *
+ *     \param *devices         Array of handles.
+ *     \param n                Number of handles in the array.
+ *     \param now              The current time in milliseconds, see ds18b20_start_conversion_at.
+ *     \return                 1 if successful, 0 if no device is responding.
+ *
+ *     Example:  ds18b20_start_conversion_all(devices, n, ms);
+ *               ...
+ *               if (ds18b20_conversion_done(ms)) ds18b20_read_all(devices, n);
+ */
+int ds18b20_start_conversion_all(const struct ds18b20_device *devices, int n, uint16_t now);
+
 
 #ifdef __cplusplus
 }
@@ -15,8 +15,8 @@
  *          ds1307.h:        Engine gets input from a DS1307
  *          timer.h:         Engine uses a Timer object to control the behavior of the display and other things.
  *          avr/interrupt.h: This program uses interrupts to interface with the user.
- *          stdio.h:         Engine uses functions from stdio.h, specifically sprintf.
- *          util/delay.h:    Engine relies on delays to control the execution of some functions.
+ *          format.h:        Engine uses these functions to prepare the display output.
+ *          scheduler.h:     Engine runs the display update, the colon and the display state as periodic tasks.
  *
  * License:
  * 
@@ -40,29 +40,33 @@
  *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */ 
 
-/*
- *     F_CPU has to be defined in order to use the delay function in util/delay.h
- *     if you use a 16Mhz crystal as a clock for the mcu, then leave this unchanged, 
- *     if not alter it accordingly
- */
-#ifndef F_CPU
-#define F_CPU 16000000ul
-#endif
-
 //  define the interrupt pin
-#define BUTTON_INT_PIN       0x04;
+#define BUTTON_INT_PIN       0x04
+#define SQW_INT_PIN          0x08
 
-//  define macros to control external interrupts
+//  define macro to enable external interrupts
 #define __enable_ext_ints__  EIMSK |= 0x03
-#define __disable_ext_ints__ EIMSK &= 0xFC
+
+//  define the periods of the tasks, in milliseconds
+#define DISPLAY_PERIOD       100
+#define COLON_PERIOD         500
+#define STATE_PERIOD         100
+
+//  define the time the button must be quiet before a press is accepted, in milliseconds
+#define DEBOUNCE_TIME        50
+
+//  define the events that ISRs send to the main loop
+#define EVENT_BUTTON         0x01
+#define EVENT_MASK           (sizeof(_events) - 1)
 
 
 //  include libraries
 #include <avr/interrupt.h>
-#include <stdio.h>
-#include <util/delay.h>
+#include <util/atomic.h>
 
 #include "engine.h"
+#include "format.h"
+#include "scheduler.h"
 
 /*
  *     Interrupt Service Routines (ISR) need access to engine and Timer
@@ -75,9 +79,15 @@ static Timer   _stimer;						//  ISR updates Timer
  */
 ISR(INT0_vect)
 {
-	__disable_ext_ints__;
 	_sinstance -> button_pressed();
-	__enable_ext_ints__;
+}
+
+/*
+ *     The DS1307 square wave output on PD3 (INT1) calls this ISR once every second
+ */
+ISR(INT1_vect)
+{
+	_sinstance -> clock_tick();
 }
 
 /*
@@ -215,8 +225,15 @@ Engine::Engine() : _dstate{this}, _astate{this}
 		//  initialize static variable
 	_sinstance = this;
 	
-		//  initialize display
+		//  the event queue is empty
+	_event_head = 0;
+	_event_tail = 0;
+	_last_edge  = 0;
+	_debouncing = false;
+	
+		//  initialize display and let it transmit in the background
 	_display.init();
+	_display.defer(ON);
 	
 		//  initialize and configure clock
 	_clock.init();	
@@ -231,27 +248,89 @@ Engine::Engine() : _dstate{this}, _astate{this}
 	_MI = PM;
 	_clock.set_12hms(_A, _B, _C, _MI);
 	_clock.transfer_data();
+	_clock.keep_time(3600);						//  count seconds from the square wave, read the clock once an hour
 	
 		//  initialize and configure display states
 	_dstate.set_next_state(&_astate);
 	_astate.set_next_state(&_dstate);
 	_current_state = &_dstate;
+	
+		//  each part of the program runs at its own rate
+	sched_add(&display_task, this, DISPLAY_PERIOD, 0);
+	sched_add(&state_task, this, STATE_PERIOD, 0);
+	_colon_task = sched_add(&colon_task, this, COLON_PERIOD, COLON_PERIOD);
 		
 		//  enable and configure interrupts
 	DDRD  = 0x00;							//  clear data direction register on port d
 	PORTD |= BUTTON_INT_PIN;					//  set port bit 2 to enable internal pull up on PD2 (INT0)
+	PORTD |= SQW_INT_PIN;						//  SQW/OUT is open drain, enable internal pull up on PD3 (INT1)
 	
-	EICRA  = 0x0A;							//  rising edge generates an external interrupt request
+	EICRA  = 0x0A;							//  falling edge on INT0 and INT1 generates an external interrupt request
 	SREG  |= 0x80;							//  enable interrupts by setting BIT7 in the Status Register	
 }
 
 /*
- *     Notify engine about button press. This should 
- *     only be called from the ISR.
+ *     Notify engine about button press. This should only be called from
+ *     the ISR. A bouncing contact makes several interrupts for each press, 
+ *     and more when it is released, so this only remembers the time of the 
+ *     edge and queues an event. The main loop decides if it was a press, 
+ *     see debounce(), so the ISR returns at once.
  */
 void Engine::button_pressed()
 {
-	_current_state -> button_pressed();
+	_last_edge = timer_millis();
+	
+	uint8_t head = _event_head;
+	uint8_t next = (head + 1) & EVENT_MASK;
+	if (next == _event_tail) return;					//  queue full, drop the event
+	_events[head] = EVENT_BUTTON;
+	_event_head   = next;							//  publish the event after it is written
+}
+
+/*
+ *     Handle the events queued by the ISRs. The display commands that follow
+ *     a button press run here, outside the ISR.
+ */
+void Engine::dispatch_events()
+{
+	while (_event_tail != _event_head)
+	{
+		uint8_t tail  = _event_tail;
+		uint8_t event = _events[tail];
+		_event_tail   = (tail + 1) & EVENT_MASK;				//  free the slot
+		
+		if (event == EVENT_BUTTON) _debouncing = true;
+	}
+	debounce();
+}
+
+/*
+ *     Accept a button press when the contact has been quiet for DEBOUNCE_TIME
+ *     since the last edge, and the button is still down. The edges when the 
+ *     button is released bounce as well, but the button is up when they end.
+ */
+void Engine::debounce()
+{
+	uint32_t last;
+	
+	if (!_debouncing) return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)					//  the ISR writes all 4 bytes
+	{
+		last = _last_edge;
+	}
+	if (timer_millis() - last < DEBOUNCE_TIME) return;
+	
+	_debouncing = false;
+	if (!(PIND & BUTTON_INT_PIN)) _current_state -> button_pressed();	//  the pull-up keeps PD2 high while the button is up
+}
+
+/*
+ *     Count one second on the clock. This should only be called from 
+ *     the ISR.
+ */
+void Engine::clock_tick()
+{
+	_clock.tick();
 }
 
 /*
@@ -280,7 +359,7 @@ void Engine::displaystate_changed()
 		_display.backlight(ON);
 		_current_state -> reset();				//  reset timeout
 		_show_colon = true;					//  start with a visible colon
-		_countdown = 500;					//  initialize countdown timer.
+		sched_restart(_colon_task);				//  and keep it for a full period.
 	}
 	else
 	{
@@ -290,59 +369,80 @@ void Engine::displaystate_changed()
 }
 
 /*
- *     The main loop updates and displays the time if the display
- *     is active and controls the timer.
+ *     The main loop handles events and runs the tasks when they are due, 
+ *     and sleeps in between. The timer, the push button and the square 
+ *     wave wake it.
  */
 void Engine::main_loop()
 {
-	int delta;							//  The execution time of the last iteration of main loop.
 	while(true)
 	{
-		delta = _stimer.stop();					//  New delta
-		
-		
-		if (_current_state->is_active())			//  Is the display active?
-		{
-			//  update state
-			_current_state->update(delta);			//  If active, update the timeout counter in display state.
-			
-			//  update countdown
-			_countdown -= delta;				//  Update the timeout counter for the colon.
-			if (_countdown <= 0)				//  If timed out ...
-			{
-				_show_colon ^= 1;			//  ... toggle colon visibility by xor'ing with 1.
-				_countdown = 500;			//  Reset countdown.
-			}
-		}
-		
-		_stimer.start();					//  Start the timer.
-		
-		if (_current_state->is_active()) update();		//  Only update if display is active.
-				
-		_delay_ms(100);						//  Delay 100ms between iterations
+		dispatch_events();
+		sched_run();
+		sched_idle();
 	}
 }
 
 /*
- *     Updates the information in the display. 
+ *     Task that updates and displays the time if the display is active,
+ *     and keeps the display queue moving.
+ *
+ *     \param *engine     The Engine.
+ */
+void Engine::display_task(void *engine)
+{
+	Engine *e = static_cast<Engine*>(engine);
+	
+	if (e -> _current_state -> is_active()) e -> update();		//  Only update if display is active.
+	e -> _display.service();
+}
+
+/*
+ *     Task that toggles the visibility of the colon between hours and minutes.
+ *
+ *     \param *engine     The Engine.
+ */
+void Engine::colon_task(void *engine)
+{
+	Engine *e = static_cast<Engine*>(engine);
+	
+	if (e -> _current_state -> is_active()) e -> _show_colon ^= 1;	//  toggle colon visibility by xor'ing with 1.
+}
+
+/*
+ *     Task that updates the timeout counter in the display state.
+ *
+ *     \param *engine     The Engine.
+ */
+void Engine::state_task(void *engine)
+{
+	Engine *e = static_cast<Engine*>(engine);
+	
+	e -> _current_state -> update(STATE_PERIOD);
+}
+
+/*
+ *     Updates the information in the display. The date and time are drawn
+ *     into the display's frame, and only the characters that changed since
+ *     the last update are transmitted.
  */
 void Engine::update()
 {
-	_clock.update();						//  Update clock.
+	_clock.poll(timer_millis());					//  Update clock, only reads the DS1307 now and then.
 		
-		//  get and print date
+		//  get and draw date
 	_clock.get_ymd(_A, _B, _C);					//  Grab data from _clock instance.
-	sprintf(_buffer, "%02i.%02i.20%02i", _C, _B, _A);		//  Prepare display buffer.
-	_display.pos(FIRST, 3);						//  Move cursor into position.
-	_display.print(_buffer);					//  Display date.
+	char *p = fmt_2digits(_buffer, _C);				//  Prepare display buffer, dd.mm.20yy
+	*p++ = '.';
+	p = fmt_2digits(p, _B);
+	*p++ = '.'; *p++ = '2'; *p++ = '0';
+	fmt_2digits(p, _A);
+	_display.draw(FIRST, 3, _buffer);				//  Draw date.
 	
-		//  get and print time
+		//  get and draw time, with or without the colon between hour and minute
 	_clock.get_12hms(_A, _B, _C, _MI);
-	sprintf(_buffer, "%02i %02i %2s", _A, _B, (_MI ? "PM" : "AM"));
-	_display.pos(SECOND, 4);
-	_display.print(_buffer);
+	fmt_hhmm_ampm(_buffer, _A, _B, (_show_colon ? ':' : ' '), _MI);
+	_display.draw(SECOND, 4, _buffer);
 	
-		//  print or hide colon between hour and minute
-	_display.pos(SECOND, 6);
-	_display.print(_show_colon ? ":" : " ");
+	_display.flush();						//  Transmit what changed.
 }
@@ -15,8 +15,8 @@
  *          ds1307.h:        Engine gets input from a DS1307
  *          timer.h:         Engine uses a Timer object to control the behavior of the display and other things.
  *          avr/interrupt.h: This program uses interrupts to interface with the user.
- *          stdio.h:         Engine uses functions from stdio.h, specifically sprintf.
- *          util/delay.h:    Engine relies on delays to control the execution of some functions.
+ *          format.h:        Engine uses these functions to prepare the display output.
+ *          scheduler.h:     Engine runs the display update, the colon and the display state as periodic tasks.
  *
  * License:
  * 
@@ -120,13 +120,23 @@ class Engine : public StateMachine
 	public:
 		Engine();
 		
-		void button_pressed();						//  call this from Interrupt Service Routine (ISR)
+		void button_pressed();						//  call this from Interrupt Service Routine (ISR), only queues an event
+		void clock_tick();						//  call this from the ISR on each falling edge of SQW/OUT
 		void run();							//  call this to start the engine/program
 		
 		virtual void displaystate_changed();				//  an instance of DisplayState calls this when state changes
 	private:	
 		void main_loop();						
-		void update();							//  does updating between iterations in main loop.
+		void dispatch_events();						//  handles the events queued by the ISRs
+		void debounce();							//  accepts a button press when the contact is quiet
+		void update();							//  draws date and time on the display.
+		
+		/*
+		 *     Periodic tasks, run by the scheduler. The argument is the Engine.
+		 */
+		static void display_task(void *engine);				//  updates the display
+		static void colon_task(void *engine);				//  blinks the colon
+		static void state_task(void *engine);				//  counts down the display state timeout
 		
 		LCD    _display;						
 		DS1307 _clock;							//  real time clock
@@ -139,7 +149,18 @@ class Engine : public StateMachine
 		 *     The following variables are used to control this behavior.
 		 */
 		bool   _show_colon;						//  the colon between hours and minutes
-		int    _countdown;						//  counts down the time for colon to remain (in)visible.
+		int    _colon_task;						//  scheduler slot of colon_task, restarted when the display is activated.
+		
+		/*
+		 *     Events from the ISRs wait in a queue until the main loop handles them.
+		 *     The ISR only writes _event_head and the main loop only writes _event_tail, 
+		 *     so no locking is needed. The size must be a power of 2.
+		 */
+		volatile uint8_t  _events[8];
+		volatile uint8_t  _event_head;				//  next event to be written, by the ISR
+		volatile uint8_t  _event_tail;				//  next event to be read, by the main loop
+		volatile uint32_t _last_edge;				//  timestamp of the last edge on INT0, written by the ISR
+		bool              _debouncing;				//  edges were seen, the press isn't accepted yet
 		
 		/*
 		 *     mcu's don't handle new and delete very well, so a solution is to keep states 
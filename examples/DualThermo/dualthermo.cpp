@@ -45,32 +45,69 @@
 #define F_CPU 16000000ul
 #endif
 
-#include <stdio.h>
-#include <util/delay.h>
+#include <avr/interrupt.h>
 #include "lcd.h"
 #include "ds18b20.h"
+#include "format.h"
+#include "timer.h"
+#include "scheduler.h"
+
+#define MEASURE_PERIOD 5000							//  milliseconds between readings
+#define POLL_PERIOD    10							//  milliseconds between checks for a finished conversion
 
 LCD   display;
-char  display_buffer[6];							//  for preparing display output
-float temp;
+Timer timer;
+char  display_buffer[8];							//  for preparing display output
 
-	//  Known ROM codes of the two ds18b20 thermometers, stored in little-endian format
-	//  NB: Yours will be different.
-unsigned char ROMa[8]  = {0x28, 0x6e, 0x38, 0xdd, 0x06, 0x00, 0x00, 0x39};
-unsigned char ROMb[8]  = {0x28, 0x1c, 0x56, 0x5b, 0x0d, 0x00, 0x00, 0x6d};
+	//  the two ds18b20 thermometers, found by searching the line
+ds18b20_device thermo[2];
+bool           converting = false;
+
+/*
+ *     The timer/counter 0 interrupt counts milliseconds for the scheduler
+ */
+ISR(TIMER0_COMPA_vect)
+{
+	timer++;
+}
 
 
 /*
  *     Display temperature on a given line of the display
  *
- *     \param temp     temperature
+ *     \param temp     temperature in 1/16 degrees
  *     \param line     display line, either FIRST or SECOND. Enum defined in lcd.h
  */
-void display_temp(float temp, lcd_line line)
+void display_temp(int16_t temp, lcd_line line)
 {
-	sprintf(display_buffer, "%2d.%1d%c", (int)temp, (int)(temp * 10) % 10, (char)223);
-	display.pos(line, 11);
-	display.print(display_buffer);
+	char *p = fmt_tenths(display_buffer, ds18b20_to_tenths(temp), 4);
+	*p++ = (char)223;							//  degree symbol
+	*p   = 0;
+	display.draw(line, 11, display_buffer);
+	display.flush();						//  only transmits the digits that changed
+}
+
+/*
+ *     Task that notifies all devices on the line to start temperature conversion.
+ */
+void measure_task(void *)
+{
+	ds18b20_start_conversion_all(thermo, 2, timer_millis());
+	converting = true;
+}
+
+/*
+ *     Task that gets and displays both temperatures when the conversion has
+ *     taken as long as it takes at the resolution set.
+ */
+void read_task(void *)
+{
+	if (!converting || !ds18b20_conversion_done(timer_millis())) return;
+	converting = false;
+	
+	ds18b20_read_all(thermo, 2);
+	display_temp(thermo[0].temp, FIRST);
+	display_temp(thermo[1].temp, SECOND);
 }
 
 
@@ -81,37 +118,36 @@ int main(void)
     display.init();
 	display.backlight(ON);
 	
+		//  find the thermometers, exit on failure
+	if (ds18b20_find(thermo, 2) < 2)
+	{
+		display.print("DS18b20 offline.");
+		return 1;
+	}
+	
 		//  the following text never changes
 	display.print("Thermo 1:");
 	display.line(SECOND);
 	display.print("Thermo 2:");
 	
-		//  initialize thermometers
-	ds18b20_set_rom(ROMa);							//  deactivate all but this
-	ds18b20_set_resolution(DS18B20_9BIT);					//  set resolution to 9 bits
-	
-	ds18b20_set_rom(ROMb);
-	ds18b20_set_resolution(DS18B20_9BIT);
+		//  set resolution to 9 bits and keep it in EEPROM. This only talks to
+		//  the thermometers the first time, after that they boot with 9 bits.
+	for (int i = 0; i < 2; i++)
+	{
+		ds18b20_device_set_resolution(&thermo[i], DS18B20_9BIT);
+		ds18b20_device_save(&thermo[i]);
+	}
 		
 	
+		//  measure every 5 sec, and sleep while waiting
+	sched_add(&measure_task, nullptr, MEASURE_PERIOD, 0);
+	sched_add(&read_task, nullptr, POLL_PERIOD, POLL_PERIOD);
+	sei();
+	
 		//  main loop		
 	while(true)
 	{		
-			//  notify all devices on the line to start temperature conversion
-		ds18b20_start_conversion();			
-		_delay_ms(100);							//  wait for conversion
-		
-			//  get and display first temperature
-		ds18b20_set_rom(ROMa);
-		ds18b20_read_temp(&temp);
-		display_temp(temp, FIRST);
-		
-			//  get and display second temperature
-		ds18b20_set_rom(ROMb);
-		ds18b20_read_temp(&temp);
-		display_temp(temp, SECOND);
-		
-			//  wait 5 sec before reading again
-		_delay_ms(5000);		
+		sched_run();
+		sched_idle();
 	}
 }
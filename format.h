@@ -0,0 +1,136 @@
+/*
+ * format.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To format numbers for display output without the use of sprintf.
+ *
+ *          sprintf from stdio.h costs several kilobytes of flash and is slow. The
+ *          functions in this header only handle the few fixed-width fields that the
+ *          projects actually display, and write directly into a caller supplied buffer.
+ *
+ *          Every function writes a terminating NUL character and returns a pointer to it,
+ *          so calls can be chained to build a string:
+ *
+ *          char *p = fmt_2digits(buffer, day);
+ *          *p++ = '.';
+ *          p = fmt_2digits(p, month);
+ *
+ * Limitations:
+ *
+ *          The functions don't check the size of the buffer. The number of characters
+ *          written is given in the description of each function, not including the
+ *          terminating NUL character.
+ *
+ * Dependencies:
+ *
+ *          stdint.h:     This library uses fixed width integer types.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *     Write a number as two digits, zero padded. Same as "%02u".
+ *     Writes 2 characters.
+ *
+ *     \param *p        Pointer to the buffer.
+ *     \param n         Number, 0 - 99.
+ *     \return          Pointer to the terminating NUL character.
+ */
+static inline char *fmt_2digits(char *p, uint8_t n)
+{
+	p[0] = '0' + n / 10;
+	p[1] = '0' + n % 10;
+	p[2] = 0;
+	return p + 2;
+}
+
+/*
+ *     Write a temperature, or any number with one decimal, given in tenths.
+ *     The number is right aligned and padded with spaces to fill at least
+ *     width characters. f.ex. -53 is written as "-5.3", and 7 as "0.7".
+ *     Writes width characters, or more if the number doesn't fit.
+ *
+ *     \param *p        Pointer to the buffer.
+ *     \param tenths    The number multiplied by 10.
+ *     \param width     Minimum number of characters.
+ *     \return          Pointer to the terminating NUL character.
+ */
+static inline char *fmt_tenths(char *p, int16_t tenths, uint8_t width)
+{
+	char     digits[8];							//  sign, 5 digits and the decimal point, backwards
+	uint8_t  len = 0;
+	uint16_t n   = (tenths < 0) ? -(uint16_t)tenths : (uint16_t)tenths;
+
+	digits[len++] = '0' + n % 10;						//  decimal
+	digits[len++] = '.';
+	n /= 10;
+	do
+	{
+		digits[len++] = '0' + n % 10;					//  integral part, at least one digit
+		n /= 10;
+	} while (n);
+	if (tenths < 0) digits[len++] = '-';
+
+	for (; width > len; width--) *p++ = ' ';
+	while (len) *p++ = digits[--len];
+	*p = 0;
+	return p;
+}
+
+/*
+ *     Write a 12 hour time as "HH:MM AM" or "HH:MM PM". The hour is zero padded.
+ *     Writes 8 characters.
+ *
+ *     \param *p        Pointer to the buffer.
+ *     \param h         Hour, 1 - 12.
+ *     \param m         Minute, 0 - 59.
+ *     \param sep       Character between hour and minute, f.ex ':', or ' ' to make the colon blink.
+ *     \param pm        0 for AM, anything else for PM.
+ *     \return          Pointer to the terminating NUL character.
+ */
+static inline char *fmt_hhmm_ampm(char *p, uint8_t h, uint8_t m, char sep, uint8_t pm)
+{
+	p    = fmt_2digits(p, h);
+	*p++ = sep;
+	p    = fmt_2digits(p, m);
+	p[0] = ' ';
+	p[1] = pm ? 'P' : 'A';
+	p[2] = 'M';
+	p[3] = 0;
+	return p + 3;
+}
+
+#ifdef __cplusplus
+}
+#endif
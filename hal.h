@@ -0,0 +1,71 @@
+/*
+ * hal.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To give the drivers one place to get their hardware definitions from, so they
+ *          can be built for something other than the MCU, f.ex a simulation on a PC.
+ *
+ *          By default, this header includes the usual AVR headers and nothing changes. If
+ *          HAL_HOST is defined in the project's symbols, it includes "hal_host.h" instead,
+ *          which the host build must supply, see host/hal_host.h. hal_host.h must define:
+ *
+ *          - the registers the drivers use (TWCR, TWDR, TWSR, TWBR, PORTx, DDRx, PINx, 
+ *            UCSR0A, UDR0, TCCR0A, OCR0A, TCNT0, TIFR0 and so on) and their bit names, 
+ *            as variables or as expressions that call into the simulated devices
+ *          - ISR, sei, cli and ATOMIC_BLOCK
+ *          - PROGMEM, pgm_read_byte, pgm_read_word and strcpy_P
+ *          - HAL_POLL(), see below
+ *
+ *          The host build must also put its own util/delay.h first on the include path,
+ *          so _delay_us and _delay_ms can advance the simulated time.
+ *
+ *          HAL_POLL() is called each time a driver waits for the hardware, f.ex for the 
+ *          TWINT flag of the TWI module. On the MCU it does nothing. In a simulation, it 
+ *          lets the simulated devices answer, so the waits end.
+ *
+ * Dependencies:
+ *
+ *          avr/io.h, avr/interrupt.h, avr/pgmspace.h and util/atomic.h, unless HAL_HOST 
+ *          is defined.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifdef HAL_HOST
+
+#include "hal_host.h"
+
+#else
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#define HAL_POLL() ((void)0)
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * bench.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To measure the drivers on the simulated devices, see sim.h, and check that
+ *          they still work. For each scenario it prints the bytes on the TWI bus, the
+ *          1-Wire time slots divided by 8, the reset pulses, the time the buses were busy,
+ *          the time the CPU was busy and the time it took. The exit status is 1 if a check
+ *          fails or a device saw an error, so the benchmarks can run in CI.
+ *
+ *          lcd redraw     Write all 32 characters with draw and flush.
+ *          probe cycle    Start a conversion on 20 DS18B20 at mixed resolutions, wait
+ *                         for it with ds18b20_conversion_done and read them all. With
+ *                         OWI_MULTI_BUS, the probes are spread over the buses in OWI_BUSES,
+ *                         which must be on PORTB, and each bus converts at the same time.
+ *          clock update   One minute of the DigitalClock display, reading the time from
+ *                         the DS1307 every second.
+ *          clock sqw      The same, counting the seconds from the square wave output,
+ *                         with keep_time and poll.
+ *
+ *          The rest run with interrupts enabled. The CPU is idle while it waits.
+ *
+ *          twi queue      Queue a read of the time, a write and a read back of NVRAM
+ *                         with twi_submit.
+ *          lcd deferred   Clear and redraw the display in deferred mode at 400kHz.
+ *          owi async      Read the scratchpad of each probe with owi_submit, only with
+ *                         OWI_ASYNC.
+ *          timer tick     One second of the millisecond interrupt of timer.cpp, with
+ *                         timer_micros read now and then.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "lcd.h"
+#include "ds1307.h"
+#include "ds18b20.h"
+#include "onewire.h"
+#include "timer.h"
+#include "format.h"
+
+
+
+#define PROBES         20
+#define CLOCK_SECONDS  60
+#define TIMER_SAMPLES  1000
+
+/*
+ *     The pin of each 1-Wire bus.
+ */
+#ifdef OWI_MULTI_BUS
+#define BUS_PIN(n, port, ddr, pin, mask)  mask,
+static const uint8_t _bus_pins[OWI_BUS_COUNT] = {OWI_BUSES(BUS_PIN)};
+#else
+static const uint8_t _bus_pins[OWI_BUS_COUNT] = {0x01};
+#endif
+
+static sim_lcd     _display_model(0x27);
+static sim_ds1307  _clock_model;
+static sim_ds18b20 *_probe_models[PROBES];
+
+static LCD    _display;
+static DS1307 _clock;
+static struct ds18b20_device _probes[PROBES];
+static int _bus_first[OWI_BUS_COUNT + 1];				//  the probes on bus b are _bus_first[b] - _bus_first[b + 1] - 1
+
+static int _failures = 0;
+
+
+
+static void check(bool ok, const char *what)
+{
+	if (ok) return;
+	printf("FAIL: %s\n", what);
+	_failures++;
+}
+
+static void select_bus(uint8_t bus)
+{
+#ifdef OWI_MULTI_BUS
+	owi_select_bus(bus);
+#else
+	(void)bus;
+#endif
+}
+
+/*
+ *     The probe a model stands for, or 0 if it wasn't found.
+ */
+static struct ds18b20_device *find_probe(const sim_ds18b20 *model)
+{
+	for (uint8_t i = 0; i < PROBES; i++)
+	{
+		if (memcmp(_probes[i].rom, model->rom, 8) == 0) return &_probes[i];
+	}
+	return 0;
+}
+
+static int16_t expected_temp(const sim_ds18b20 *model)
+{
+	uint8_t undefined = 3 - ((model->eeprom[2] >> 5) & 0x03);
+	return model->temperature & ~((1 << undefined) - 1);
+}
+
+static void report(const char *name, const sim_stats *start)
+{
+	sim_stats end;
+	sim_read_stats(&end);
+
+	uint64_t elapsed = end.time_ns - start->time_ns;
+	uint64_t idle    = end.idle_ns - start->idle_ns;
+	uint64_t bus     = (end.twi_ns - start->twi_ns) + (end.owi_ns - start->owi_ns);
+
+	printf("%-14s %9u %9u %7u %10.3f %10.3f %10.3f\n", name,
+	       end.twi_bytes - start->twi_bytes, (end.owi_slots - start->owi_slots) / 8, end.owi_resets - start->owi_resets,
+	       bus / 1e6, (elapsed - idle) / 1e6, elapsed / 1e6);
+}
+
+
+
+/******************************************************************************************************
+ *                                           SCENARIOS                                                *
+ ******************************************************************************************************/
+
+static void lcd_redraw()
+{
+	static const char *lines[2] = {"Full redraw test", "0123456789ABCDEF"};
+	char text[17];
+	sim_stats start;
+
+	sim_read_stats(&start);
+	_display.draw(FIRST, 0, lines[0]);
+	_display.draw(SECOND, 0, lines[1]);
+	_display.flush();
+	report("lcd redraw", &start);
+
+	for (uint8_t row = 0; row < 2; row++)
+	{
+		_display_model.text(row, text);
+		check(strcmp(text, lines[row]) == 0, "the display shows what was drawn");
+	}
+}
+
+static void probe_cycle()
+{
+	sim_stats start;
+
+	int       n = 0;
+
+	sim_read_stats(&start);
+	for (uint8_t bus = 0; bus < OWI_BUS_COUNT; bus++)
+	{
+		select_bus(bus);
+		check(ds18b20_start_conversion_all(&_probes[_bus_first[bus]], _bus_first[bus + 1] - _bus_first[bus], sim_millis()),
+		      "the conversion starts");
+	}
+	for (uint8_t bus = 0; bus < OWI_BUS_COUNT; bus++)
+	{
+		select_bus(bus);
+		while (!ds18b20_conversion_done(sim_millis())) sim_idle_us(1000);
+		n += ds18b20_read_all(&_probes[_bus_first[bus]], _bus_first[bus + 1] - _bus_first[bus]);
+	}
+	report("probe cycle", &start);
+
+	check(n == PROBES, "all probes are read");
+	for (uint8_t i = 0; i < PROBES; i++)
+	{
+		const struct ds18b20_device *probe = find_probe(_probe_models[i]);
+		check(probe != 0, "every probe is found");
+		if (!probe) continue;
+		check(probe->status == DS18B20_OK, "the probe was read");
+		check(probe->temp == expected_temp(_probe_models[i]), "the temperature is right");
+	}
+}
+
+/*
+ *     Draw the date and time as the DigitalClock example does, and check that the
+ *     display shows the time the DS1307 has.
+ */
+static void clock_refresh()
+{
+	uint8_t y, mth, d, h, m, s;
+	char    buffer[11], expected[11], text[17];
+
+	_clock.get_ymd(y, mth, d);
+	char *p = fmt_2digits(buffer, d);
+	*p++ = '.';
+	p = fmt_2digits(p, mth);
+	*p++ = '.';
+	*p++ = '2';
+	*p++ = '0';
+	fmt_2digits(p, y);
+	_display.draw(FIRST, 3, buffer);
+
+	_clock.get_24hms(h, m, s);
+	p = fmt_2digits(buffer, h);
+	*p++ = ':';
+	p = fmt_2digits(p, m);
+	*p++ = ':';
+	fmt_2digits(p, s);
+	_display.draw(SECOND, 4, buffer);
+
+	_display.flush();
+
+	const uint8_t *regs = _clock_model.regs;
+	snprintf(expected, sizeof(expected), "%02x:%02x:%02x", regs[2] & 0x3F, regs[1], regs[0] & 0x7F);
+	_display_model.text(SECOND, text);
+	check(strncmp(text + 4, expected, 8) == 0, "the display shows the time of the DS1307");
+}
+
+/*
+ *     Wait until 5ms into the next simulated second.
+ */
+static void next_second()
+{
+	uint64_t next = (sim_now() / SIM_S + 1) * SIM_S + 5 * SIM_MS;
+	sim_idle_us((next - sim_now()) / 1e3);
+}
+
+static void clock_tick()
+{
+	_clock.tick();
+}
+
+static void clock_update()
+{
+	sim_stats start;
+
+	next_second();
+	sim_read_stats(&start);
+	for (uint8_t i = 0; i < CLOCK_SECONDS; i++)
+	{
+		_clock.update();
+		clock_refresh();
+		next_second();
+	}
+	report("clock update", &start);
+}
+
+static void clock_sqw()
+{
+	sim_stats start;
+
+	_clock_model.on_tick = clock_tick;
+	_clock.keep_time();
+
+	next_second();
+	sim_read_stats(&start);
+	for (uint8_t i = 0; i < CLOCK_SECONDS; i++)
+	{
+		_clock.poll(sim_millis());
+		clock_refresh();
+		next_second();
+	}
+	report("clock sqw", &start);
+
+	_clock.sqw(SQWOFF);
+}
+
+static void twi_queue()
+{
+	static unsigned char nvram[4] = {0x12, 0x34, 0x56, 0x78};
+	unsigned char time[7], back[4];
+	struct twi_transaction read  = {0x68, 0x00, TWI_READ | TWI_REGISTER, time, 7, TWI_IDLE, 0};
+	struct twi_transaction write = {0x68, 0x08, TWI_WRITE | TWI_REGISTER, nvram, 4, TWI_IDLE, 0};
+	struct twi_transaction again = {0x68, 0x08, TWI_READ | TWI_REGISTER, back, 4, TWI_IDLE, 0};
+	sim_stats start;
+
+	next_second();
+	sim_read_stats(&start);
+	check(twi_submit(&read) && twi_submit(&write) && twi_submit(&again), "the transactions are queued");
+	while (twi_is_busy()) sim_idle_us(10);
+	report("twi queue", &start);
+
+	check(read.status == TWI_DONE && write.status == TWI_DONE && again.status == TWI_DONE, "the transactions are done");
+	check(memcmp(time, _clock_model.regs, 7) == 0, "the time read is the time of the DS1307");
+	check(memcmp(back, nvram, 4) == 0, "NVRAM reads back what was written");
+}
+
+/*
+ *     The clear display pad is sized from the SCL frequency of the display, so at
+ *     400kHz the display reports an error if the pad is too short.
+ */
+static void lcd_deferred()
+{
+	static const char *lines[2] = {"Deferred redraw!", "FEDCBA9876543210"};
+	char text[17];
+	sim_stats start;
+
+	twi_set_device_speed(0x27, 400000ul);
+	_display.defer(ON);
+
+	sim_read_stats(&start);
+	_display.clear();
+	_display.draw(FIRST, 0, lines[0]);
+	_display.draw(SECOND, 0, lines[1]);
+	_display.flush();
+	while (!_display.service()) sim_idle_us(10);
+	report("lcd deferred", &start);
+
+	_display.defer(OFF);
+	twi_set_device_speed(0x27, 0);
+
+	for (uint8_t row = 0; row < 2; row++)
+	{
+		_display_model.text(row, text);
+		check(strcmp(text, lines[row]) == 0, "the display shows what was drawn");
+	}
+}
+
+#ifdef OWI_ASYNC
+static void owi_async()
+{
+	uint8_t   command[10] = {0x55, 0, 0, 0, 0, 0, 0, 0, 0, 0xBE};		//  match ROM and read scratchpad
+	uint8_t   scratchpad[9];
+	struct    owi_transaction t = {command, 10, scratchpad, 9, OWI_IDLE, 0, 0};
+	int       n = 0;
+	sim_stats start;
+
+	sim_read_stats(&start);
+	for (uint8_t bus = 0; bus < OWI_BUS_COUNT; bus++)
+	{
+		select_bus(bus);
+		for (int i = _bus_first[bus]; i < _bus_first[bus + 1]; i++)
+		{
+			memcpy(&command[1], _probes[i].rom, 8);
+			check(owi_submit(&t), "the transaction is submitted");
+			while (t.status == OWI_PENDING) sim_idle_us(10);
+
+			uint8_t undefined = 3 - ((scratchpad[4] >> 5) & 0x03);			//  the low bits aren't defined below 12 bits
+			int16_t temp = (int16_t)((scratchpad[1] << 8) | scratchpad[0]) & ~((1 << undefined) - 1);
+			if (t.status == OWI_DONE && owi_crc8(scratchpad, 9) == 0 && temp == _probes[i].temp) n++;
+		}
+	}
+	select_bus(0);
+	report("owi async", &start);
+
+	check(n == PROBES, "the scratchpad of every probe is read in the background");
+}
+#endif
+
+ISR(TIMER0_COMPA_vect)
+{
+	timer_tick();
+}
+
+/*
+ *     timer_micros must never go backwards, and must keep up with the time.
+ */
+static void timer_ticks()
+{
+	sim_stats start;
+	bool      monotonic = true;
+
+	timer_init();
+	uint64_t t0   = sim_now();
+	uint32_t ms0  = timer_millis();
+	uint32_t us0  = timer_micros();
+	uint32_t last = us0;
+
+	sim_read_stats(&start);
+	for (uint16_t i = 0; i < TIMER_SAMPLES; i++)
+	{
+		sim_idle_us(997);							//  a different count each time
+		uint32_t us = timer_micros();
+		if ((int32_t)(us - last) <= 0) monotonic = false;
+		last = us;
+	}
+	report("timer tick", &start);
+
+	TIMSK0 = 0x00;
+	TCCR0B = 0x00;
+
+	int64_t drift = (int64_t)(last - us0) - (int64_t)((sim_now() - t0) / SIM_US);
+	check(monotonic, "timer_micros never goes backwards");
+	check(drift > -(SIM_ISR_US + 4) && drift <= 4, "timer_micros keeps up with the time");
+	check(timer_millis() - ms0 == (sim_now() - t0) / SIM_MS, "timer_millis counts the milliseconds");
+}
+
+
+
+int main()
+{
+	static const uint8_t resolutions[4] = {DS18B20_9BIT, DS18B20_10BIT, DS18B20_11BIT, DS18B20_12BIT};
+	sim_stats end;
+
+		//  20 probes from -12 to 47.4 degrees
+	uint64_t serial = 0x2A17;
+	for (uint8_t i = 0; i < PROBES; i++)
+	{
+		serial = serial * 6364136223846793005ull + 1442695040888963407ull;
+		_probe_models[i] = new sim_ds18b20(serial >> 16, -192 + i * 50, resolutions[i % 4], _bus_pins[i % OWI_BUS_COUNT]);
+	}
+
+	_display.init();
+	_clock.init();
+	for (uint8_t bus = 0; bus < OWI_BUS_COUNT; bus++)
+	{
+		select_bus(bus);
+		_bus_first[bus + 1] = _bus_first[bus] + ds18b20_find(&_probes[_bus_first[bus]], PROBES - _bus_first[bus]);
+	}
+	select_bus(0);
+	check(_bus_first[OWI_BUS_COUNT] == PROBES, "ds18b20_find finds all probes");
+
+	printf("%-14s %9s %9s %7s %10s %10s %10s\n", "scenario", "TWI bytes", "OWI bytes", "resets", "bus ms", "CPU ms", "time ms");
+	lcd_redraw();
+	probe_cycle();
+	clock_update();
+	clock_sqw();
+
+	sei();
+	twi_queue();
+	lcd_deferred();
+#ifdef OWI_ASYNC
+	owi_async();
+#endif
+	timer_ticks();
+	cli();
+
+	sim_read_stats(&end);
+	check(end.errors == 0, "the devices saw no errors");
+
+	if (_failures) printf("%d checks failed\n", _failures);
+	return _failures ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * hal_host.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: The hardware definitions hal.h includes when the drivers are built for the
+ *          simulation on a PC, see hal.h and sim.h.
+ *
+ *          The registers are objects of class hal_reg, so the simulation sees each time
+ *          a driver writes or reads one. Writing TWCR starts a TWI operation, writing
+ *          DDRB or PORTB moves the 1-Wire lines on PORTB and reading PINB samples them,
+ *          writing UDR0 transmits on USART0, and the timer registers start, stop and 
+ *          read Timer0 and Timer2. The other registers just hold what is written to them.
+ *
+ *          SREG holds the I bit. sei, cli and ATOMIC_BLOCK set and clear it as on the MCU,
+ *          and the simulation calls an ISR when its interrupt is pending and enabled and
+ *          the I bit is set. The I bit is clear at start, as after a reset.
+ *
+ * Limitations:
+ *
+ *          The drivers are compiled as C++, since a register must be an object. A register
+ *          can't be reached through a volatile uint8_t pointer, but the drivers only name 
+ *          the registers directly.
+ *
+ * Dependencies:
+ *
+ *          stdint.h and string.h
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#ifndef __cplusplus
+#error "the host build compiles the drivers as C++, see host/Makefile"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ *     The registers the simulation reacts to have their own id, the rest share HAL_PLAIN.
+ */
+enum hal_reg_id : uint8_t {HAL_PLAIN, HAL_TWCR, HAL_TWSR, HAL_TWDR, HAL_DDRB, HAL_PORTB, HAL_PINB, HAL_SREG,
+                          HAL_TCCR0B, HAL_TCNT0, HAL_TIFR0, HAL_TCCR2B, HAL_TCNT2, HAL_TIFR2, HAL_UCSR0A, HAL_UDR0};
+
+uint8_t sim_reg_read(uint8_t id, uint8_t value);					//  in sim.cpp
+void    sim_reg_write(uint8_t id, uint8_t &value, uint8_t data);
+void    sim_poll(void);
+
+class hal_reg
+{
+	public:
+		explicit hal_reg(uint8_t id = HAL_PLAIN) : value{0}, _id{id} {}
+
+		operator uint8_t() const                { return sim_reg_read(_id, value); }
+		hal_reg &operator=(uint8_t data)        { sim_reg_write(_id, value, data); return *this; }
+		hal_reg &operator=(const hal_reg &reg)  { return *this = (uint8_t)reg; }
+		hal_reg &operator|=(int data)           { return *this = (uint8_t)(*this | data); }	//  int, as ~mask is
+		hal_reg &operator&=(int data)           { return *this = (uint8_t)(*this & data); }
+		hal_reg &operator^=(int data)           { return *this = (uint8_t)(*this ^ data); }
+
+		uint8_t value;									//  what the simulation keeps in the register
+
+	private:
+		uint8_t _id;
+};
+
+/*
+ *     Registers
+ */
+extern hal_reg TWCR, TWSR, TWBR, TWDR;
+extern hal_reg PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+extern hal_reg TCCR0A, TCCR0B, OCR0A, OCR0B, TIMSK0, TCNT0, TIFR0;
+extern hal_reg TCCR2A, TCCR2B, OCR2A, TIMSK2, TCNT2, TIFR2;
+extern hal_reg UCSR0A, UCSR0B, UCSR0C, UDR0;
+extern hal_reg EIMSK, EICRA, EIFR, SMCR, PRR, SREG;
+extern uint16_t UBRR0;
+
+/*
+ *     Bit names
+ */
+#define TWINT   7
+#define TWEA    6
+#define TWSTA   5
+#define TWSTO   4
+#define TWWC    3
+#define TWEN    2
+#define TWIE    0
+#define TWPS0   0
+#define TWPS1   1
+
+#define WGM01   1
+#define WGM21   1
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define CS20    0
+#define CS21    1
+#define CS22    2
+#define OCIE0A  1
+#define OCIE0B  2
+#define OCIE2A  1
+#define OCF0A   1
+#define OCF2A   1
+
+#define RXC0    7
+#define TXC0    6
+#define UDRE0   5
+#define U2X0    1
+#define RXCIE0  7
+#define RXEN0   4
+#define TXEN0   3
+#define UCSZ01  2
+#define UCSZ00  1
+
+#define INT0    0
+#define INT1    1
+#define INTF0   0
+#define INTF1   1
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+
+#define _BV(bit) (1 << (bit))
+
+/*
+ *     Interrupts. An ISR is an ordinary function, that the simulation calls. ATOMIC_BLOCK
+ *     restores SREG however the block is left, as in util/atomic.h.
+ */
+#define ISR(vector)  extern "C" void vector(void); extern "C" void vector(void)
+#define sei()        (SREG |= 0x80)
+#define cli()        (SREG &= ~0x80)
+
+#define ATOMIC_RESTORESTATE  0x00
+#define ATOMIC_FORCEON       0x80
+
+static inline uint8_t hal_atomic_begin(uint8_t type)
+{
+	uint8_t sreg = SREG.value | type;
+
+	SREG.value &= ~0x80;
+	return sreg;
+}
+
+static inline void hal_atomic_end(const uint8_t *sreg)
+{
+	SREG = *sreg;
+}
+
+#define ATOMIC_BLOCK(type)  for (uint8_t _hal_sreg __attribute__((cleanup(hal_atomic_end))) = hal_atomic_begin(type), \
+                                 _hal_once = 1; _hal_once; _hal_once = 0)
+
+/*
+ *     Program memory is ordinary memory.
+ */
+#define PROGMEM
+#define PSTR(s)               (s)
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+#define strcpy_P(dst, src)    strcpy((dst), (src))
+
+/*
+ *     Waiting for the hardware lets the simulated devices finish what they are doing.
+ */
+#define HAL_POLL() sim_poll()
@@ -0,0 +1,683 @@
+/*
+ * sim.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: The simulated time, the registers, the interrupts, the TWI module, the timers
+ *          and USART0, see sim.h.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "sim.h"
+
+
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+/*
+ *     A wait for the hardware that hasn't ended after this many polls never will, and
+ *     an interrupt called this many times in a row never clears its flag.
+ */
+#define SIM_POLL_LIMIT       1000000ul
+#define SIM_INTERRUPT_LIMIT  100
+
+#define SIM_NEVER            UINT64_MAX
+#define SIM_I_BIT            0x80						//  global interrupt enable in SREG
+
+/*
+ *     TWI status codes, the same as in twi.c
+ */
+#define TWI_START          0x08
+#define TWI_REP_START      0x10
+#define TWI_MT_SLA_ACK     0x18
+#define TWI_MT_SLA_NACK    0x20
+#define TWI_MT_DATA_ACK    0x28
+#define TWI_MT_DATA_NACK   0x30
+#define TWI_MR_SLA_ACK     0x40
+#define TWI_MR_SLA_NACK    0x48
+#define TWI_MR_DATA_ACK    0x50
+#define TWI_MR_DATA_NACK   0x58
+#define TWI_BUS_ERROR      0x00
+
+/*
+ *     What the TWI module expects next.
+ */
+enum sim_twi_state : uint8_t {TWI_STATE_IDLE, TWI_STATE_ADDRESS, TWI_STATE_TRANSMIT, TWI_STATE_RECEIVE, TWI_STATE_NONE};
+
+
+
+/*
+ *     The registers
+ */
+hal_reg TWCR(HAL_TWCR), TWSR(HAL_TWSR), TWBR, TWDR(HAL_TWDR);
+hal_reg PORTB(HAL_PORTB), DDRB(HAL_DDRB), PINB(HAL_PINB), PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+hal_reg TCCR0A, TCCR0B(HAL_TCCR0B), OCR0A, OCR0B, TIMSK0, TCNT0(HAL_TCNT0), TIFR0(HAL_TIFR0);
+hal_reg TCCR2A, TCCR2B(HAL_TCCR2B), OCR2A, TIMSK2, TCNT2(HAL_TCNT2), TIFR2(HAL_TIFR2);
+hal_reg UCSR0A(HAL_UCSR0A), UCSR0B, UCSR0C, UDR0(HAL_UDR0);
+hal_reg EIMSK, EICRA, EIFR, SMCR, PRR, SREG(HAL_SREG);
+uint16_t UBRR0;
+
+static uint64_t        _sim_now     = 0;
+static uint32_t        _sim_polls   = 0;					//  polls since the hardware last did something
+static uint64_t        _sim_isr_ns  = 0;					//  time spent in interrupts
+static sim_stats       _sim_stats   = {};
+static sim_twi_device *_sim_devices = 0;
+
+/*
+ *     The TWI module. An operation ends at done, and sets TWINT then.
+ */
+static struct
+{
+	uint8_t         state;
+	bool            active;							//  between start and stop condition
+	sim_twi_device *device;							//  the device addressed
+	bool            pending;
+	uint64_t        done;
+	uint64_t        free;							//  the bus is free from this time
+	uint8_t         status;
+	uint8_t         data;							//  the byte received
+	bool            receive;
+} _twi = {TWI_STATE_IDLE, false, 0, false, 0, 0, 0, 0, false};
+
+/*
+ *     A timer counts from base, when the count was last 0, at the prescaler chosen
+ *     by the clock select bits, and starts over when it reaches OCRnA. While it is 
+ *     stopped, the count is kept in count.
+ */
+struct sim_timer
+{
+	hal_reg        &tccrb;
+	hal_reg        &ocra;
+	hal_reg        &tifr;
+	const uint16_t *prescalers;						//  for clock select 1 - 7, 0 for an external clock
+	uint64_t        base;
+	uint8_t         count;
+};
+
+static const uint16_t _timer0_prescalers[7] = {1, 8, 64, 256, 1024, 0, 0};
+static const uint16_t _timer2_prescalers[7] = {1, 8, 32, 64, 128, 256, 1024};
+
+static sim_timer _timer0 = {TCCR0B, OCR0A, TIFR0, _timer0_prescalers, 0, 0};
+static sim_timer _timer2 = {TCCR2B, OCR2A, TIFR2, _timer2_prescalers, 0, 0};
+
+/*
+ *     USART0. A frame is the start bit, 8 data bits lsb first and the stop bit. It
+ *     pulls the line low from the start bit until the first 1 bit, and releases it
+ *     at rise. The receiver samples each bit in the middle, and the frame is received
+ *     at done.
+ */
+static struct
+{
+	bool     busy;								//  a frame is being transmitted
+	bool     low;								//  the line is still pulled low
+	uint64_t start;
+	uint64_t rise;
+	uint64_t done;
+	uint64_t bit;								//  nanoseconds per bit
+	uint8_t  data;								//  the byte received
+} _usart = {false, false, 0, 0, 0, 0, 0xFF};
+
+/*
+ *     The interrupts, in order of priority. An interrupt is pending while its flag is
+ *     set, and enabled while its enable bit is set. The compare match flags are cleared
+ *     when the ISR is called, RXC0 when UDR0 is read and TWINT by the ISR.
+ */
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern "C" void USART_RX_vect(void) __attribute__((weak));
+extern "C" void TWI_vect(void) __attribute__((weak));
+
+struct sim_vector
+{
+	void   (*isr)(void);							//  0 if the program has none
+	hal_reg &flags;
+	uint8_t  flag;
+	hal_reg &mask;
+	uint8_t  enable;
+	bool     clear;								//  the flag is cleared when the ISR is called
+};
+
+static const sim_vector _sim_vectors[4] =
+{
+	{TIMER2_COMPA_vect, TIFR2,  1 << OCF2A, TIMSK2, 1 << OCIE2A, true},
+	{TIMER0_COMPA_vect, TIFR0,  1 << OCF0A, TIMSK0, 1 << OCIE0A, true},
+	{USART_RX_vect,     UCSR0A, 1 << RXC0,  UCSR0B, 1 << RXCIE0, false},
+	{TWI_vect,          TWCR,   1 << TWINT, TWCR,   1 << TWIE,   false},
+};
+
+
+
+/******************************************************************************************************
+ *                                              TIME                                                  *
+ ******************************************************************************************************/
+
+static void     twi_complete();
+static uint64_t timer_next(const sim_timer *timer);
+static void     timer_run(sim_timer *timer);
+static void     usart_run();
+static void     sim_interrupts();
+
+/*
+ *     The time of the next thing the hardware does, or SIM_NEVER.
+ */
+static uint64_t sim_next_event()
+{
+	uint64_t next = SIM_NEVER;
+	uint64_t t;
+
+	if (_twi.pending) next = _twi.done;
+	if (_usart.busy && (t = _usart.low ? _usart.rise : _usart.done) < next) next = t;
+	if ((t = timer_next(&_timer0)) < next) next = t;
+	if ((t = timer_next(&_timer2)) < next) next = t;
+	return next;
+}
+
+static void sim_run_devices()
+{
+	for (sim_twi_device *device = _sim_devices; device; device = device->next) device->run(_sim_now);
+}
+
+/*
+ *     Move the time forward, let the hardware and the devices catch up, and call the 
+ *     interrupts on the way.
+ */
+static void sim_advance_to(uint64_t t)
+{
+	for (uint64_t next; (next = sim_next_event()) <= t; )
+	{
+		if (next > _sim_now) _sim_now = next;
+		if (_twi.pending && _twi.done <= _sim_now) twi_complete();
+		usart_run();
+		timer_run(&_timer0);
+		timer_run(&_timer2);
+		sim_run_devices();
+		sim_interrupts();
+	}
+	if (t > _sim_now) _sim_now = t;
+	sim_run_devices();
+}
+
+uint64_t sim_now()
+{
+	return _sim_now;
+}
+
+uint16_t sim_millis()
+{
+	return (uint16_t)(_sim_now / SIM_MS);
+}
+
+/*
+ *     The delay loop doesn't count while an interrupt runs, so an interrupted delay
+ *     takes longer.
+ */
+void sim_delay_us(double us)
+{
+	if (us <= 0) return;
+
+	uint64_t end = _sim_now + (uint64_t)(us * SIM_US + 0.5);
+	uint64_t isr = _sim_isr_ns;
+
+	_sim_polls = 0;
+	for (;;)
+	{
+		sim_advance_to(end);
+		if (_sim_isr_ns == isr) break;
+		end += _sim_isr_ns - isr;
+		isr  = _sim_isr_ns;
+	}
+}
+
+void sim_idle_us(double us)
+{
+	uint64_t start = _sim_now;
+	uint64_t isr   = _sim_isr_ns;
+
+	_sim_polls = 0;
+	sim_advance_to(_sim_now + (uint64_t)(us * SIM_US + 0.5));
+	_sim_stats.idle_ns += (_sim_now - start) - (_sim_isr_ns - isr);
+}
+
+/*
+ *     A driver waits for the hardware. Whatever it waits for is finished now,
+ *     so let the next thing the hardware does happen.
+ */
+void sim_poll(void)
+{
+	uint64_t next = sim_next_event();
+
+	if (++_sim_polls == SIM_POLL_LIMIT)
+	{
+		fprintf(stderr, "sim: a driver waits for hardware that does nothing\n");
+		exit(2);
+	}
+	if (next != SIM_NEVER) sim_advance_to(next);
+}
+
+void sim_read_stats(sim_stats *stats)
+{
+	sim_owi_account(&_sim_stats);
+	_sim_stats.time_ns = _sim_now;
+	*stats = _sim_stats;
+}
+
+void sim_error(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	fprintf(stderr, "sim: %8.3fms: ", _sim_now / 1e6);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+	_sim_stats.errors++;
+}
+
+
+
+/******************************************************************************************************
+ *                                              TWI                                                   *
+ ******************************************************************************************************/
+
+sim_twi_device::sim_twi_device(uint8_t address) : address{address}, next{_sim_devices}
+{
+	_sim_devices = this;
+}
+
+/*
+ *     One SCL period, from TWBR and the prescaler in TWSR.
+ */
+static uint64_t twi_bit_ns()
+{
+	uint32_t divider = 16 + 2ul * TWBR.value * (1u << (2 * (TWSR.value & 0x03)));
+	return divider * SIM_S / F_CPU;
+}
+
+static sim_twi_device *twi_find(uint8_t address)
+{
+	sim_twi_device *device = _sim_devices;
+	while (device && device->address != address) device = device->next;
+	return device;
+}
+
+/*
+ *     Start the operation requested by writing TWCR with TWINT set.
+ */
+static void twi_operation(uint8_t control)
+{
+	uint64_t bit   = twi_bit_ns();
+	uint64_t start = (_twi.free > _sim_now) ? _twi.free : _sim_now;
+	uint64_t time  = 0;
+
+	_twi.receive = false;
+
+	if (control & (1 << TWSTO))
+	{
+		if (_twi.device) _twi.device->stop();
+		_twi.device = 0;
+		_twi.active = false;
+		_twi.state  = TWI_STATE_IDLE;
+		_twi.free   = start + bit;
+		_sim_stats.twi_ns += bit;
+		TWCR.value &= ~(1 << TWSTO);						//  done before the next operation can start
+
+		if (!(control & (1 << TWSTA))) return;				//  a stop condition doesn't set TWINT
+		start = _twi.free;
+	}
+
+	if (control & (1 << TWSTA))
+	{
+		_twi.status = _twi.active ? TWI_REP_START : TWI_START;
+		_twi.active = true;
+		_twi.device = 0;
+		_twi.state  = TWI_STATE_ADDRESS;
+		time = bit;
+	}
+	else switch (_twi.state)
+	{
+		case TWI_STATE_ADDRESS:
+		{
+			bool read = TWDR.value & 0x01;
+			sim_twi_device *device = twi_find(TWDR.value >> 1);
+			bool ack  = device && device->start(read);
+
+			_twi.device = ack ? device : 0;
+			_twi.state  = ack ? (read ? TWI_STATE_RECEIVE : TWI_STATE_TRANSMIT) : TWI_STATE_NONE;
+			if (read) _twi.status = ack ? TWI_MR_SLA_ACK : TWI_MR_SLA_NACK;
+			else      _twi.status = ack ? TWI_MT_SLA_ACK : TWI_MT_SLA_NACK;
+			_sim_stats.twi_bytes++;
+			time = 9 * bit;
+			break;
+		}
+		case TWI_STATE_TRANSMIT:
+			_twi.status = _twi.device->write(TWDR.value) ? TWI_MT_DATA_ACK : TWI_MT_DATA_NACK;
+			_sim_stats.twi_bytes++;
+			time = 9 * bit;
+			break;
+		case TWI_STATE_RECEIVE:
+			_twi.data    = _twi.device->read();
+			_twi.receive = true;
+			_twi.status  = (control & (1 << TWEA)) ? TWI_MR_DATA_ACK : TWI_MR_DATA_NACK;
+			_sim_stats.twi_bytes++;
+			time = 9 * bit;
+			break;
+		default:
+			sim_error("TWI: data transferred without a start condition");
+			_twi.status = TWI_BUS_ERROR;
+			break;
+	}
+
+	_twi.pending = true;
+	_twi.done    = start + time;
+	_twi.free    = _twi.done;
+	_sim_stats.twi_ns += time;
+}
+
+static void twi_complete()
+{
+	_sim_polls   = 0;
+	_twi.pending = false;
+	if (_twi.receive) TWDR.value = _twi.data;
+	TWSR.value  = _twi.status | (TWSR.value & 0x03);
+	TWCR.value |= (1 << TWINT);
+}
+
+/*
+ *     Writing a one to TWINT clears the flag and starts an operation. Writing a
+ *     zero leaves the flag as it is.
+ */
+static void twcr_write(uint8_t &value, uint8_t data)
+{
+	uint8_t flag = value & (1 << TWINT);
+
+	value = data & ~(1 << TWINT);
+	if (!(data & (1 << TWINT))) value |= flag;
+
+	if (!(data & (1 << TWEN)))
+	{
+		_twi.state   = TWI_STATE_IDLE;
+		_twi.active  = false;
+		_twi.device  = 0;
+		_twi.pending = false;
+		return;
+	}
+	if (data & (1 << TWINT)) twi_operation(data);
+}
+
+
+
+/******************************************************************************************************
+ *                                            TIMERS                                                  *
+ ******************************************************************************************************/
+
+/*
+ *     The prescaler, or 0 if the timer is stopped.
+ */
+static uint16_t timer_prescaler(const sim_timer *timer, uint8_t control)
+{
+	uint8_t select = control & 0x07;
+	return select ? timer->prescalers[select - 1] : 0;
+}
+
+static uint64_t timer_ns(uint64_t ticks, uint16_t prescaler)
+{
+	return ticks * prescaler * SIM_S / F_CPU;
+}
+
+static uint8_t timer_count(const sim_timer *timer)
+{
+	uint16_t prescaler = timer_prescaler(timer, timer->tccrb.value);
+
+	if (!prescaler) return timer->count;
+	return (uint8_t)((_sim_now - timer->base) * F_CPU / (prescaler * SIM_S));
+}
+
+/*
+ *     The next compare match.
+ */
+static uint64_t timer_next(const sim_timer *timer)
+{
+	uint16_t prescaler = timer_prescaler(timer, timer->tccrb.value);
+
+	if (!prescaler) return SIM_NEVER;
+	return timer->base + timer_ns(timer->ocra.value + 1, prescaler);
+}
+
+/*
+ *     In CTC mode, the count starts over at each compare match, and the flag is set.
+ */
+static void timer_run(sim_timer *timer)
+{
+	for (uint64_t next; (next = timer_next(timer)) <= _sim_now; )
+	{
+		timer->base        = next;
+		timer->tifr.value |= (1 << OCF0A);					//  OCF0A and OCF2A are the same bit
+	}
+}
+
+/*
+ *     Starting, stopping or changing the prescaler keeps the count.
+ */
+static void timer_control(sim_timer *timer, uint8_t data)
+{
+	uint8_t  count     = timer_count(timer);
+	uint16_t prescaler = timer_prescaler(timer, data);
+
+	timer->tccrb.value = data;
+	timer->count       = count;
+	timer->base        = _sim_now - timer_ns(count, prescaler);
+}
+
+static void timer_set_count(sim_timer *timer, uint8_t data)
+{
+	timer->count = data;
+	timer->base  = _sim_now - timer_ns(data, timer_prescaler(timer, timer->tccrb.value));
+}
+
+
+
+/******************************************************************************************************
+ *                                            USART0                                                  *
+ ******************************************************************************************************/
+
+/*
+ *     Writing UDR0 transmits a frame on the 1-Wire line of PB0. A 1-Wire time slot
+ *     or reset pulse is a byte with some low bits followed by high bits, so there is
+ *     one falling and one rising edge.
+ */
+static void usart_transmit(uint8_t data)
+{
+	uint8_t zeros = 0;
+
+	if (!(UCSR0B.value & (1 << TXEN0))) return;
+	if (_usart.busy)
+	{
+		sim_error("USART: UDR0 written while a frame is transmitted");
+		return;
+	}
+	while (zeros < 8 && !(data & (1 << zeros))) zeros++;
+	if ((data | ((1 << zeros) - 1)) != 0xFF) sim_error("USART: 0x%02x is not a 1-Wire time slot", data);
+
+	_usart.bit   = (UBRR0 + 1ull) * ((UCSR0A.value & (1 << U2X0)) ? 8 : 16) * SIM_S / F_CPU;
+	_usart.busy  = true;
+	_usart.low   = true;
+	_usart.start = _sim_now;
+	_usart.rise  = _sim_now + (1 + zeros) * _usart.bit;
+	_usart.done  = _sim_now + 10 * _usart.bit;
+	sim_owi_drive(0, true);
+}
+
+/*
+ *     Release the line, and receive the echo of the frame when it is done.
+ */
+static void usart_run()
+{
+	if (!_usart.busy) return;
+	if (_usart.low && _usart.rise <= _sim_now)
+	{
+		_usart.low = false;
+		sim_owi_drive(0, false);
+	}
+	if (_usart.low || _usart.done > _sim_now) return;
+
+	uint8_t echo = 0;
+	for (uint8_t bit = 0; bit < 8; bit++)
+	{
+		uint64_t sample = _usart.start + (2 * bit + 3) * _usart.bit / 2;
+		if (sample >= _usart.rise && sim_owi_level(0, sample)) echo |= 1 << bit;
+	}
+	_usart.busy = false;
+	_sim_polls  = 0;
+	if (!(UCSR0B.value & (1 << RXEN0))) return;
+	_usart.data    = echo;
+	UCSR0A.value  |= (1 << RXC0);
+}
+
+
+
+/******************************************************************************************************
+ *                                          INTERRUPTS                                                *
+ ******************************************************************************************************/
+
+/*
+ *     Call the pending interrupts that are enabled, while the I bit is set. As on the
+ *     MCU, the I bit is cleared while an ISR runs.
+ */
+static void sim_interrupts()
+{
+	for (uint8_t calls = 0; SREG.value & SIM_I_BIT; calls++)
+	{
+		const sim_vector *vector = 0;
+		for (const sim_vector &v : _sim_vectors)
+		{
+			if ((v.flags.value & v.flag) && (v.mask.value & v.enable))
+			{
+				vector = &v;
+				break;
+			}
+		}
+		if (!vector) return;
+		if (calls == SIM_INTERRUPT_LIMIT)
+		{
+			fprintf(stderr, "sim: an interrupt never clears its flag\n");
+			exit(2);
+		}
+		if (!vector->isr)
+		{
+			sim_error("an interrupt is enabled, but there is no ISR for it");
+			vector->mask.value &= ~vector->enable;
+			continue;
+		}
+
+		uint64_t start = _sim_now;
+		if (vector->clear) vector->flags.value &= ~vector->flag;
+		SREG.value &= ~SIM_I_BIT;
+		_sim_stats.interrupts++;
+		sim_advance_to(_sim_now + SIM_ISR_US * SIM_US);
+		vector->isr();
+		SREG.value |= SIM_I_BIT;
+		_sim_isr_ns += _sim_now - start;
+	}
+}
+
+
+
+/******************************************************************************************************
+ *                                           REGISTERS                                                *
+ ******************************************************************************************************/
+
+uint8_t sim_reg_read(uint8_t id, uint8_t value)
+{
+	switch (id)
+	{
+		case HAL_PINB:
+			return sim_owi_pins();
+		case HAL_TCNT0:
+			return timer_count(&_timer0);
+		case HAL_TCNT2:
+			return timer_count(&_timer2);
+		case HAL_UDR0:
+			UCSR0A.value &= ~(1 << RXC0);
+			return _usart.data;
+		default:
+			return value;
+	}
+}
+
+/*
+ *     A write may enable an interrupt that is pending, or set the I bit.
+ */
+void sim_reg_write(uint8_t id, uint8_t &value, uint8_t data)
+{
+	switch (id)
+	{
+		case HAL_TWCR:
+			twcr_write(value, data);
+			break;
+		case HAL_TWSR:
+			value = (value & 0xF8) | (data & 0x03);				//  only the prescaler bits are writable
+			break;
+		case HAL_DDRB:
+			value = data;
+			sim_owi_line(DDRB.value, PORTB.value);
+			break;
+		case HAL_PORTB:
+			value = data;
+			sim_owi_line(DDRB.value, PORTB.value);
+			break;
+		case HAL_TCCR0B:
+			timer_control(&_timer0, data);
+			break;
+		case HAL_TCNT0:
+			timer_set_count(&_timer0, data);
+			break;
+		case HAL_TCCR2B:
+			timer_control(&_timer2, data);
+			break;
+		case HAL_TCNT2:
+			timer_set_count(&_timer2, data);
+			break;
+		case HAL_TIFR0:
+		case HAL_TIFR2:
+			value &= ~data;								//  writing a one clears a flag
+			break;
+		case HAL_UCSR0A:
+			value = (value & (1 << RXC0)) | (data & ~(1 << RXC0));		//  RXC0 is read only
+			break;
+		case HAL_UDR0:
+			usart_transmit(data);
+			break;
+		default:
+			value = data;
+			break;
+	}
+	sim_interrupts();
+}
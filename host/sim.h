@@ -0,0 +1,273 @@
+/*
+ * sim.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To run the drivers on a PC against simulated devices, so they can be measured
+ *          and tested without flashing a board.
+ *
+ *          The simulation keeps the time in nanoseconds. It only moves when a driver calls
+ *          _delay_us or _delay_ms, when it waits for the hardware with HAL_POLL(), or when
+ *          the program calls sim_idle_us. The drivers' own instructions take no time, so
+ *          the CPU-busy time is the time spent waiting for delays and devices, which is
+ *          what dominates on the MCU as well.
+ *
+ *          The TWI module runs the bus as the ATmega328P does: writing TWCR starts a start
+ *          condition, a byte or a stop condition, and TWINT is set when it is done, after
+ *          9 SCL periods for a byte at the speed set by TWBR and TWSR. The devices on the
+ *          bus are objects of class sim_twi_device, found by their address.
+ *
+ *          Each pin of PORTB is a 1-Wire line, PB0 by default, and each sim_owi_device is
+ *          attached to one of them. The simulation follows a line as the driver pulls and
+ *          releases it, and each device takes part in each time slot the way a real slave
+ *          does: it may pull the line low for 30us from the falling edge, and it reads the
+ *          bit the master wrote when the line is released. USART0 transmits and receives
+ *          on the line of PB0, as if TXD and RXD were joined to it, for OWI_UART.
+ *
+ *          Timer0 and Timer2 count in CTC mode at the prescaler set in TCCRnB, and set the
+ *          compare flag when they reach OCRnA. The interrupts are called as the time passes,
+ *          while the I bit in SREG is set, see sei, for the TWI module, the compare matches
+ *          of Timer0 and Timer2, and USART0 receive complete. Each interrupt takes 
+ *          SIM_ISR_US of CPU time, for the registers saved and restored and a short body,
+ *          and a delay that is interrupted takes longer, as on the MCU.
+ *
+ *          Example:
+ *
+ *          sim_lcd    display_model(0x27);			//  the devices, before the drivers use them
+ *          sim_ds1307 clock_model;
+ *          LCD        display;
+ *          ...
+ *          sim_read_stats(&before);
+ *          display.flush();
+ *          sim_read_stats(&after);				//  after.twi_bytes - before.twi_bytes ...
+ *
+ * Limitations:
+ *
+ *          See hal_host.h. 1-Wire overdrive isn't simulated. The timers only count in CTC mode.
+ *
+ * Dependencies:
+ *
+ *          stdint.h      This library uses fixed width integer types.
+ *          hal_host.h    The registers.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "hal_host.h"
+
+#define SIM_US    1000ull							//  nanoseconds
+#define SIM_MS    1000000ull
+#define SIM_S     1000000000ull
+
+/*
+ *     Time
+ */
+uint64_t sim_now();								//  nanoseconds since the start
+uint16_t sim_millis();								//  milliseconds since the start
+void     sim_idle_us(double us);						//  let time pass with the CPU idle, interrupts run
+
+#define SIM_ISR_US  4								//  CPU time of one interrupt
+
+/*
+ *     Counters, from the start of the simulation. Subtract two readings to measure
+ *     something.
+ */
+struct sim_stats
+{
+	uint64_t time_ns;							//  the time of the reading
+	uint64_t idle_ns;							//  time passed in sim_idle_us, not in interrupts
+	uint32_t interrupts;							//  interrupts called
+	uint32_t twi_bytes;							//  addresses and data bytes on the TWI bus
+	uint64_t twi_ns;							//  time the TWI bus was busy
+	uint32_t owi_slots;							//  1-Wire time slots, 8 for each byte
+	uint32_t owi_resets;
+	uint64_t owi_ns;							//  time the 1-Wire lines were busy, summed
+	uint32_t errors;							//  protocol or timing errors the devices noticed
+};
+
+void sim_read_stats(sim_stats *stats);
+
+/*
+ *     Called by the devices when the drivers do something a real device would not accept.
+ */
+void sim_error(const char *format, ...);
+
+/*
+ *     A device on the TWI bus. It takes part in the transactions addressed to it.
+ */
+class sim_twi_device
+{
+	public:
+		explicit sim_twi_device(uint8_t address);				//  attaches the device to the bus
+		virtual ~sim_twi_device() {}
+
+		virtual bool    start(bool read) = 0;					//  addressed, returns true to ACK
+		virtual bool    write(uint8_t data) = 0;				//  returns true to ACK
+		virtual uint8_t read() = 0;
+		virtual void    stop() {}
+		virtual void    run(uint64_t now) { (void)now; }			//  called as the time passes
+
+		const uint8_t   address;
+		sim_twi_device *next;
+};
+
+/*
+ *     A slave on a 1-Wire line.
+ */
+class sim_owi_device
+{
+	public:
+		explicit sim_owi_device(uint8_t pin = 0x01);				//  attaches the device to the line of this PORTB pin
+		virtual ~sim_owi_device() {}
+
+		virtual bool reset(uint64_t now) = 0;					//  reset pulse, returns true for a presence pulse
+		virtual bool slot_begin(uint64_t now) = 0;				//  falling edge, returns false to pull the line low
+		virtual void slot_end(bool bit, uint64_t now) = 0;			//  the bit on the bus in this slot
+
+		const uint8_t   pin;							//  mask of the pin
+		sim_owi_device *next;
+};
+
+/*
+ *     A 16x2 display with an HD44780 controller behind a PCF8574 port expander, wired
+ *     as lcd.cpp expects: P0 RS, P1 R/W, P2 E, P3 backlight and P4 - P7 to D4 - D7.
+ */
+class sim_lcd : public sim_twi_device
+{
+	public:
+		explicit sim_lcd(uint8_t address = 0x27);
+
+		bool    start(bool read);
+		bool    write(uint8_t data);
+		uint8_t read();
+
+		void text(uint8_t row, char *buffer) const;				//  the 16 visible characters of a row
+		bool display_on() const { return _display_on; }
+		bool backlight() const  { return _pins & 0x08; }
+
+		uint8_t cgram[64];							//  the custom characters
+
+	private:
+		void latch(uint8_t pins);						//  falling edge of E
+		void instruction(uint8_t data);
+		void character(uint8_t data);
+		bool ready();
+
+		uint8_t  _pins;								//  the PCF8574 outputs
+		uint8_t  _ddram[0x80];
+		uint8_t  _ac;								//  address counter
+		bool     _cgram_mode;							//  the address counter points to CGRAM
+		bool     _increment;
+		bool     _two_lines;
+		bool     _display_on;
+		bool     _four_bit;
+		bool     _have_high;							//  the high nybble is latched, the low one is next
+		uint8_t  _high;
+		bool     _read_high;							//  the next nybble read is the high one
+		uint8_t  _init_step;							//  function sets in 8-bit mode
+		uint64_t _busy_until;
+};
+
+/*
+ *     A DS1307 real time clock. It counts the time from the moment it is made, and
+ *     calls on_tick once every second while the square wave output is 1Hz, as the
+ *     falling edge on SQW/OUT would call an interrupt.
+ */
+class sim_ds1307 : public sim_twi_device
+{
+	public:
+		sim_ds1307();
+
+		bool    start(bool read);
+		bool    write(uint8_t data);
+		uint8_t read();
+		void    run(uint64_t now);
+
+		uint8_t regs[64];							//  time keeping registers, control and NVRAM
+		void  (*on_tick)(void);
+
+	private:
+		void advance_second();
+
+		uint8_t  _pointer;
+		bool     _first;							//  the next byte written is the register pointer
+		uint8_t  _latch[8];							//  the time as it was at the start condition
+		uint64_t _next_second;
+};
+
+/*
+ *     A DS18B20 with external power. The temperature it measures is set with
+ *     temperature, in 1/16 degrees, config is the resolution stored in EEPROM
+ *     and pin the line it is attached to.
+ */
+class sim_ds18b20 : public sim_owi_device
+{
+	public:
+		sim_ds18b20(uint64_t serial, int16_t temperature, uint8_t config = 0x7F, uint8_t pin = 0x01);
+
+		bool reset(uint64_t now);
+		bool slot_begin(uint64_t now);
+		void slot_end(bool bit, uint64_t now);
+
+		uint8_t rom[8];
+		int16_t temperature;
+		uint8_t eeprom[3];							//  TH, TL and configuration
+		uint8_t scratchpad[9];
+
+	private:
+		void receive(uint8_t data, uint64_t now);
+		void send(const uint8_t *data, uint8_t n, uint8_t then);
+		void finish(uint64_t now);
+
+		uint8_t  _state;
+		uint8_t  _then;								//  the state after sending
+		uint8_t  _rx;								//  bits received so far, lsb first
+		uint8_t  _rx_bits;
+		uint8_t  _count;							//  bytes matched or written
+		uint8_t  _tx[9];
+		uint8_t  _tx_bits;
+		uint8_t  _tx_pos;
+		uint8_t  _position;							//  search ROM: bit of the ROM code ...
+		uint8_t  _phase;							//  ... and bit, complement or direction
+		bool     _converting;
+		bool     _alarm;
+		uint64_t _busy_until;
+};
+
+/*
+ *     Maxim CRC8, computed independently of owi_crc8.
+ */
+uint8_t sim_crc8(const uint8_t *data, uint8_t n);
+
+/*
+ *     Internals shared by sim.cpp and sim_onewire.cpp
+ */
+void    sim_owi_line(uint8_t ddr, uint8_t port);				//  after a write to DDRB or PORTB
+void    sim_owi_drive(uint8_t n, bool low);					//  the master pulls or releases the line of pin n
+uint8_t sim_owi_level(uint8_t n, uint64_t t);					//  the level of the line of pin n, 1 or 0, at t after its last edge
+uint8_t sim_owi_pins();								//  the levels of the lines, one bit for each pin
+void    sim_owi_account(sim_stats *stats);
@@ -0,0 +1,165 @@
+/*
+ * sim_ds1307.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: A DS1307 real time clock, see sim.h.
+ *
+ *          The first byte written after SLA+W sets the register pointer, and each byte
+ *          read or written moves it to the next register, from 0x3F back to 0x00. As in
+ *          the DS1307, the time registers are copied at the start condition, so a read
+ *          that spans a second gives a consistent time. Writing the seconds register
+ *          restarts the second.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "sim.h"
+
+
+
+#define DS1307_ADDRESS       0x68
+#define DS1307_CLOCK_HALT    0x80
+#define DS1307_12_HOUR       0x40
+#define DS1307_PM            0x20
+#define DS1307_SQW_MASK      0x13						//  SQWE, RS1 and RS0 in the control register
+#define DS1307_SQW_1HZ       0x10
+
+static const uint8_t _days_in_month[13] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static uint8_t bcd2dec(uint8_t bcd)
+{
+	return (bcd & 0x0F) + (bcd >> 4) * 10;
+}
+
+static uint8_t dec2bcd(uint8_t dec)
+{
+	return ((dec / 10) << 4) | (dec % 10);
+}
+
+
+
+/*
+ *     The clock starts at Wed. 14. Oct. 2026, 12:00:00, 24 hour mode.
+ */
+sim_ds1307::sim_ds1307() : sim_twi_device{DS1307_ADDRESS}, on_tick{0}, _pointer{0}, _first{false},
+                           _next_second{sim_now() + SIM_S}
+{
+	static const uint8_t time[8] = {0x00, 0x00, 0x12, 0x03, 0x14, 0x10, 0x26, 0x03};
+
+	for (uint8_t i = 0; i < sizeof(regs); i++) regs[i] = 0x00;
+	for (uint8_t i = 0; i < 8; i++) regs[i] = _latch[i] = time[i];
+}
+
+bool sim_ds1307::start(bool read)
+{
+	if (!read) _first = true;
+	for (uint8_t i = 0; i < 8; i++) _latch[i] = regs[i];
+	return true;
+}
+
+bool sim_ds1307::write(uint8_t data)
+{
+	if (_first)
+	{
+		_pointer = data & 0x3F;
+		_first   = false;
+		return true;
+	}
+
+	regs[_pointer] = data;
+	if (_pointer == 0x00) _next_second = sim_now() + SIM_S;
+	_pointer = (_pointer + 1) & 0x3F;
+	return true;
+}
+
+uint8_t sim_ds1307::read()
+{
+	uint8_t data = (_pointer < 8) ? _latch[_pointer] : regs[_pointer];
+	_pointer = (_pointer + 1) & 0x3F;
+	return data;
+}
+
+/*
+ *     Count the seconds. The oscillator, and with it the square wave, stops while
+ *     the clock halt bit is set.
+ */
+void sim_ds1307::run(uint64_t now)
+{
+	while (now >= _next_second)
+	{
+		_next_second += SIM_S;
+		if (regs[0] & DS1307_CLOCK_HALT) continue;
+
+		advance_second();
+		if ((regs[7] & DS1307_SQW_MASK) == DS1307_SQW_1HZ && on_tick) on_tick();
+	}
+}
+
+void sim_ds1307::advance_second()
+{
+	uint8_t s = bcd2dec(regs[0] & 0x7F) + 1;
+	uint8_t m = bcd2dec(regs[1]);
+	regs[0] = dec2bcd(s % 60);
+	if (s < 60) return;
+	regs[1] = dec2bcd(++m % 60);
+	if (m < 60) return;
+
+	if (regs[2] & DS1307_12_HOUR)
+	{
+		uint8_t h  = bcd2dec(regs[2] & 0x1F) + 1;
+		uint8_t pm = regs[2] & DS1307_PM;
+		if (h == 13) h = 1;
+		if (h == 12) pm ^= DS1307_PM;						//  11 -> 12 toggles AM/PM
+		regs[2] = DS1307_12_HOUR | pm | dec2bcd(h);
+		if (h != 12 || pm) return;						//  a new day starts at 12 AM
+	}
+	else
+	{
+		uint8_t h = bcd2dec(regs[2] & 0x3F) + 1;
+		regs[2] = dec2bcd(h % 24);
+		if (h < 24) return;
+	}
+
+		//  next day
+	uint8_t d    = bcd2dec(regs[4]) + 1;
+	uint8_t mth  = bcd2dec(regs[5]);
+	uint8_t y    = bcd2dec(regs[6]);
+	uint8_t days = _days_in_month[mth] + (mth == 2 && (y & 0x03) == 0);
+
+	regs[3] = regs[3] % 7 + 1;
+	if (d > days)
+	{
+		d = 1;
+		if (++mth > 12)
+		{
+			mth = 1;
+			y = (y + 1) % 100;
+		}
+	}
+	regs[4] = dec2bcd(d);
+	regs[5] = dec2bcd(mth);
+	regs[6] = dec2bcd(y);
+}
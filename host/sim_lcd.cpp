@@ -0,0 +1,227 @@
+/*
+ * sim_lcd.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: A 16x2 display with an HD44780 controller behind a PCF8574 port expander,
+ *          see sim.h.
+ *
+ *          Each byte written to the PCF8574 sets its outputs. The HD44780 latches the data
+ *          pins on the falling edge of E, a whole byte in 8-bit mode and a nybble, high one
+ *          first, in 4-bit mode. After an instruction it is busy for the time the datasheet
+ *          gives, 15ms after power on, 4.1ms and 100us after the first two function sets of
+ *          the initialization, 1.52ms for clear display and return home, 37us for the other
+ *          instructions and 41us to write a character. An instruction that arrives while
+ *          it is busy is an error.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "sim.h"
+
+
+
+#define PIN_RS          0x01
+#define PIN_RW          0x02
+#define PIN_E           0x04
+
+#define LCD_POWER_ON    (15 * SIM_MS)
+#define LCD_SLOW        (1520 * SIM_US)
+#define LCD_FAST        (37 * SIM_US)
+#define LCD_WRITE       (41 * SIM_US)
+
+static const uint64_t _lcd_init_time[3] = {4100 * SIM_US, 100 * SIM_US, LCD_FAST};
+
+
+
+/*
+ *     The display is powered on when it is made.
+ */
+sim_lcd::sim_lcd(uint8_t address) : sim_twi_device{address}, _pins{0xFF}, _ac{0}, _cgram_mode{false}, _increment{true},
+                                    _two_lines{false}, _display_on{false}, _four_bit{false}, _have_high{false}, _high{0},
+                                    _read_high{true}, _init_step{0}, _busy_until{sim_now() + LCD_POWER_ON}
+{
+	for (uint8_t i = 0; i < sizeof(_ddram); i++) _ddram[i] = ' ';
+	for (uint8_t i = 0; i < sizeof(cgram); i++) cgram[i] = 0x00;
+}
+
+bool sim_lcd::start(bool read)
+{
+	(void)read;
+	return true;
+}
+
+bool sim_lcd::write(uint8_t data)
+{
+	uint8_t old = _pins;
+
+	_pins = data;
+	if ((old & PIN_E) && !(data & PIN_E)) latch(old);
+	return true;
+}
+
+/*
+ *     The pins written high can be pulled low by the display while it drives the
+ *     data bus, that is while R/W and E are high. It sends the busy flag and the
+ *     address counter, high nybble first.
+ */
+uint8_t sim_lcd::read()
+{
+	if ((_pins & (PIN_RW | PIN_E)) != (PIN_RW | PIN_E)) return _pins;
+
+	uint8_t busy   = sim_now() < _busy_until;
+	uint8_t nybble = _read_high ? ((busy << 3) | ((_ac >> 4) & 0x07)) : (_ac & 0x0F);
+	return _pins & ((nybble << 4) | 0x0F);
+}
+
+void sim_lcd::text(uint8_t row, char *buffer) const
+{
+	for (uint8_t col = 0; col < 16; col++) buffer[col] = _ddram[row * 0x40 + col];
+	buffer[16] = 0;
+}
+
+/*
+ *     An instruction may only start when the last one is done.
+ */
+bool sim_lcd::ready()
+{
+	if (sim_now() >= _busy_until) return true;
+	sim_error("LCD: instruction %.1fus before the last one was done", (_busy_until - sim_now()) / 1e3);
+	return false;
+}
+
+void sim_lcd::latch(uint8_t pins)
+{
+	uint8_t nybble = pins >> 4;
+
+	if (pins & PIN_RW)
+	{
+		_read_high = !_read_high;
+		return;
+	}
+	_read_high = true;
+
+	if (!_four_bit)
+	{
+			//  the low data pins aren't connected, so they read 0
+		if (ready()) instruction(nybble << 4);
+		return;
+	}
+
+	if (!_have_high)
+	{
+		if (!ready()) return;
+		_high      = nybble;
+		_have_high = true;
+		return;
+	}
+	_have_high = false;
+
+	uint8_t data = (_high << 4) | nybble;
+	if (pins & PIN_RS) character(data);
+	else instruction(data);
+}
+
+void sim_lcd::instruction(uint8_t data)
+{
+	uint64_t time = LCD_FAST;
+
+	if (data & 0x80)								//  set DDRAM address
+	{
+		_ac = data & 0x7F;
+		_cgram_mode = false;
+	}
+	else if (data & 0x40)								//  set CGRAM address
+	{
+		_ac = data & 0x3F;
+		_cgram_mode = true;
+	}
+	else if (data & 0x20)								//  function set
+	{
+		if (!_four_bit && _init_step < 3) time = _lcd_init_time[_init_step++];
+		_four_bit  = !(data & 0x10);
+		_two_lines = data & 0x08;
+	}
+	else if (data & 0x10)								//  cursor or display shift, not simulated
+	{
+	}
+	else if (data & 0x08)								//  display control
+	{
+		_display_on = data & 0x04;
+	}
+	else if (data & 0x04)								//  entry mode set
+	{
+		_increment = data & 0x02;
+	}
+	else if (data & 0x02)								//  return home
+	{
+		_ac = 0x00;
+		_cgram_mode = false;
+		time = LCD_SLOW;
+	}
+	else if (data & 0x01)								//  clear display
+	{
+		for (uint8_t i = 0; i < sizeof(_ddram); i++) _ddram[i] = ' ';
+		_ac = 0x00;
+		_cgram_mode = false;
+		_increment  = true;
+		time = LCD_SLOW;
+	}
+	_busy_until = sim_now() + time;
+}
+
+/*
+ *     Write to DDRAM or CGRAM and move the address counter. In 2-line mode, the
+ *     lines are 0x00 - 0x27 and 0x40 - 0x67.
+ */
+void sim_lcd::character(uint8_t data)
+{
+	_busy_until = sim_now() + LCD_WRITE;
+
+	if (_cgram_mode)
+	{
+		cgram[_ac & 0x3F] = data & 0x1F;
+		_ac = (_ac + (_increment ? 1 : -1)) & 0x3F;
+		return;
+	}
+
+	_ddram[_ac & 0x7F] = data;
+	if (_two_lines)
+	{
+		if (_increment)
+		{
+			if      (_ac == 0x27) _ac = 0x40;
+			else if (_ac == 0x67) _ac = 0x00;
+			else _ac++;
+		}
+		else
+		{
+			if      (_ac == 0x40) _ac = 0x27;
+			else if (_ac == 0x00) _ac = 0x67;
+			else _ac--;
+		}
+	}
+	else _ac = _increment ? ((_ac == 0x4F) ? 0x00 : _ac + 1) : ((_ac == 0x00) ? 0x4F : _ac - 1);
+}
@@ -0,0 +1,428 @@
+/*
+ * sim_onewire.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: The 1-Wire buses on PORTB and the DS18B20 temperature sensor, see sim.h.
+ *
+ *          Each pin of PORTB is a line of its own, with the devices attached to that pin.
+ *          A line is low while the master pulls it, that is while the data direction bit
+ *          is set and the port bit is cleared, or while the USART transmits a low bit on
+ *          it, or while a slave pulls it. A low pulse
+ *          of 480us or more is a reset pulse, and the slaves answer with a presence pulse
+ *          from 15us to 135us after the line is released. A shorter low pulse starts a time
+ *          slot. The master writes a 1 or reads if it releases the line within 15us, and
+ *          a slave that sends a 0 holds the line low for 30us from the falling edge.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "sim.h"
+
+
+
+#define OWI_RESET_MIN        (480 * SIM_US)					//  shortest reset pulse
+#define OWI_PRESENCE_BEGIN   (15 * SIM_US)					//  presence pulse, from the rising edge
+#define OWI_PRESENCE_END     (135 * SIM_US)
+#define OWI_WRITE_0_MIN      (15 * SIM_US)					//  a longer pulse writes a 0
+#define OWI_SLAVE_HOLD       (30 * SIM_US)					//  a slave sending a 0 holds the line this long
+#define OWI_SLOT_MIN         (60 * SIM_US)					//  shortest time slot ...
+#define OWI_RECOVERY         (1 * SIM_US)					//  ... and the recovery time after it
+
+/*
+ *     DS18B20 commands
+ */
+#define CMD_SEARCH_ROM       0xF0
+#define CMD_READ_ROM         0x33
+#define CMD_MATCH_ROM        0x55
+#define CMD_SKIP_ROM         0xCC
+#define CMD_ALARM_SEARCH     0xEC
+#define CMD_CONVERT_TEMP     0x44
+#define CMD_READ_SCRATCHPAD  0xBE
+#define CMD_WRITE_SCRATCHPAD 0x4E
+#define CMD_COPY_SCRATCHPAD  0x48
+#define CMD_RECALL_E2        0xB8
+#define CMD_READ_POWER       0xB4
+
+#define DS18B20_COPY_TIME    (10 * SIM_MS)
+#define DS18B20_9BIT_TIME    (93750 * SIM_US)					//  doubles for each bit of resolution
+
+/*
+ *     What a DS18B20 expects next.
+ */
+enum ds18b20_state : uint8_t {DS_IDLE, DS_ROM_COMMAND, DS_MATCH, DS_SEARCH, DS_FUNCTION, DS_WRITE, DS_SEND, DS_BUSY};
+
+
+
+static sim_owi_device *_owi_devices = 0;
+
+/*
+ *     The state of one line.
+ *
+ *     The bus time of the last slot or reset pulse is counted when the next one starts,
+ *     but not beyond the time the slot requires, so the gaps between transactions aren't
+ *     counted. A reset pulse is followed by the 480us the master must listen for the
+ *     presence pulse, a time slot lasts at least 60us, and 1us more for recovery.
+ */
+struct owi_line
+{
+	bool     master_low;
+	uint64_t fall;								//  the last falling edge
+	uint64_t slave_low;							//  a slave holds the line low until this time
+	uint64_t presence_begin;
+	uint64_t presence_end;
+	bool     open;
+	uint64_t open_since;
+	uint64_t open_until;
+};
+
+static owi_line _owi_lines[8] = {};
+static uint64_t _owi_ns       = 0;						//  summed over the lines
+static uint32_t _owi_slots    = 0;
+static uint32_t _owi_resets   = 0;
+
+
+
+/******************************************************************************************************
+ *                                              BUS                                                   *
+ ******************************************************************************************************/
+
+sim_owi_device::sim_owi_device(uint8_t pin) : pin{pin}, next{_owi_devices}
+{
+	_owi_devices = this;
+}
+
+static void owi_close(owi_line *line, uint64_t now)
+{
+	if (!line->open) return;
+	_owi_ns   += ((now < line->open_until) ? now : line->open_until) - line->open_since;
+	line->open = false;
+}
+
+void sim_owi_account(sim_stats *stats)
+{
+	for (uint8_t n = 0; n < 8; n++) owi_close(&_owi_lines[n], sim_now());
+	stats->owi_ns     = _owi_ns;
+	stats->owi_slots  = _owi_slots;
+	stats->owi_resets = _owi_resets;
+}
+
+static void owi_falling_edge(owi_line *line, uint8_t pin, uint64_t now)
+{
+	owi_close(line, now);
+	line->fall = now;
+
+	for (sim_owi_device *device = _owi_devices; device; device = device->next)
+	{
+		if (device->pin == pin && !device->slot_begin(now)) line->slave_low = now + OWI_SLAVE_HOLD;
+	}
+}
+
+static void owi_rising_edge(owi_line *line, uint8_t pin, uint64_t now)
+{
+	uint64_t length = now - line->fall;
+
+	line->open       = true;
+	line->open_since = line->fall;
+
+	if (length >= OWI_RESET_MIN)
+	{
+		bool presence = false;
+		for (sim_owi_device *device = _owi_devices; device; device = device->next)
+		{
+			if (device->pin == pin && device->reset(now)) presence = true;
+		}
+		if (presence)
+		{
+			line->presence_begin = now + OWI_PRESENCE_BEGIN;
+			line->presence_end   = now + OWI_PRESENCE_END;
+		}
+		line->slave_low  = 0;
+		line->open_until = now + OWI_RESET_MIN;
+		_owi_resets++;
+		return;
+	}
+
+		//  the slaves sample the line 15us - 60us after the falling edge
+	bool bit = (length < OWI_WRITE_0_MIN) && (line->slave_low <= line->fall);
+	for (sim_owi_device *device = _owi_devices; device; device = device->next)
+	{
+		if (device->pin == pin) device->slot_end(bit, now);
+	}
+	line->open_until = ((length < OWI_SLOT_MIN) ? line->fall + OWI_SLOT_MIN : now) + OWI_RECOVERY;
+	_owi_slots++;
+}
+
+void sim_owi_drive(uint8_t n, bool low)
+{
+	owi_line *line = &_owi_lines[n];
+
+	if (low == line->master_low) return;
+	line->master_low = low;
+	if (low) owi_falling_edge(line, 1 << n, sim_now());
+	else     owi_rising_edge(line, 1 << n, sim_now());
+}
+
+void sim_owi_line(uint8_t ddr, uint8_t port)
+{
+	uint8_t low = ddr & ~port;
+
+	for (uint8_t n = 0; n < 8; n++) sim_owi_drive(n, low & (1 << n));
+}
+
+/*
+ *     The level of a line at a time after its last edge.
+ */
+uint8_t sim_owi_level(uint8_t n, uint64_t t)
+{
+	const owi_line *line = &_owi_lines[n];
+
+	if (line->master_low) return 0;
+	if (t < line->slave_low) return 0;
+	if (t >= line->presence_begin && t < line->presence_end) return 0;
+	return 1;
+}
+
+uint8_t sim_owi_pins()
+{
+	uint8_t pins = 0;
+
+	for (uint8_t n = 0; n < 8; n++) pins |= sim_owi_level(n, sim_now()) << n;
+	return pins;
+}
+
+uint8_t sim_crc8(const uint8_t *data, uint8_t n)
+{
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		uint8_t byte = data[i];
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			uint8_t mix = (crc ^ byte) & 0x01;
+			crc >>= 1;
+			if (mix) crc ^= 0x8C;
+			byte >>= 1;
+		}
+	}
+	return crc;
+}
+
+
+
+/******************************************************************************************************
+ *                                            DS18B20                                                 *
+ ******************************************************************************************************/
+
+/*
+ *     The serial number is the 48 bits between the family code and the CRC. The
+ *     scratchpad is loaded from EEPROM, as at power on.
+ */
+sim_ds18b20::sim_ds18b20(uint64_t serial, int16_t temperature, uint8_t config, uint8_t pin) : sim_owi_device{pin},
+                                                                temperature{temperature}, _state{DS_IDLE}, _then{DS_IDLE},
+                                                                _rx{0}, _rx_bits{0}, _count{0}, _tx_bits{0}, _tx_pos{0},
+                                                                _position{0}, _phase{0}, _converting{false}, _alarm{false},
+                                                                _busy_until{0}
+{
+	rom[0] = 0x28;
+	for (uint8_t i = 1; i < 7; i++)
+	{
+		rom[i] = serial & 0xFF;
+		serial >>= 8;
+	}
+	rom[7] = sim_crc8(rom, 7);
+
+	eeprom[0] = 0x4B;								//  TH = 75 and TL = 70, as shipped
+	eeprom[1] = 0x46;
+	eeprom[2] = (config & 0x60) | 0x1F;
+
+		//  the power-on reset value of the temperature register is 85 degrees
+	scratchpad[0] = 0x50;
+	scratchpad[1] = 0x05;
+	for (uint8_t i = 0; i < 3; i++) scratchpad[i + 2] = eeprom[i];
+	scratchpad[5] = 0xFF;
+	scratchpad[6] = 0x0C;
+	scratchpad[7] = 0x10;
+	scratchpad[8] = sim_crc8(scratchpad, 8);
+}
+
+/*
+ *     Store the temperature when the conversion is done. The bits below the
+ *     resolution are undefined, so they are set here to catch a driver that
+ *     doesn't clear them.
+ */
+void sim_ds18b20::finish(uint64_t now)
+{
+	if (!_converting || now < _busy_until) return;
+	_converting = false;
+
+	uint8_t undefined = 3 - ((scratchpad[4] >> 5) & 0x03);
+	int16_t t = temperature | ((1 << undefined) - 1);
+	scratchpad[0] = t & 0xFF;
+	scratchpad[1] = (t >> 8) & 0xFF;
+	scratchpad[8] = sim_crc8(scratchpad, 8);
+
+	int8_t whole = temperature >> 4;
+	_alarm = whole >= (int8_t)scratchpad[2] || whole <= (int8_t)scratchpad[3];
+}
+
+void sim_ds18b20::send(const uint8_t *data, uint8_t n, uint8_t then)
+{
+	for (uint8_t i = 0; i < n; i++) _tx[i] = data[i];
+	_tx_bits = 8 * n;
+	_tx_pos  = 0;
+	_then    = then;
+	_state   = DS_SEND;
+}
+
+bool sim_ds18b20::reset(uint64_t now)
+{
+	finish(now);
+	_state   = DS_ROM_COMMAND;
+	_rx_bits = 0;
+	return true;
+}
+
+bool sim_ds18b20::slot_begin(uint64_t now)
+{
+	finish(now);
+
+	switch (_state)
+	{
+		case DS_SEND:
+			return _tx[_tx_pos >> 3] & (1 << (_tx_pos & 0x07));
+		case DS_SEARCH:
+		{
+			bool bit = rom[_position >> 3] & (1 << (_position & 0x07));
+			if (_phase == 0) return bit;
+			if (_phase == 1) return !bit;
+			return true;
+		}
+		case DS_BUSY:
+			return now >= _busy_until;					//  0 while busy, then 1
+		default:
+			return true;
+	}
+}
+
+void sim_ds18b20::slot_end(bool bit, uint64_t now)
+{
+	switch (_state)
+	{
+		case DS_ROM_COMMAND:
+		case DS_MATCH:
+		case DS_FUNCTION:
+		case DS_WRITE:
+			_rx = (_rx >> 1) | (bit ? 0x80 : 0x00);
+			if (++_rx_bits < 8) return;
+			_rx_bits = 0;
+			receive(_rx, now);
+			return;
+		case DS_SEND:
+			if (++_tx_pos == _tx_bits) _state = _then;
+			return;
+		case DS_SEARCH:
+			if (_phase < 2)
+			{
+				_phase++;
+				return;
+			}
+			_phase = 0;
+			if (bit != (bool)(rom[_position >> 3] & (1 << (_position & 0x07)))) _state = DS_IDLE;
+			else if (++_position == 64) _state = DS_FUNCTION;
+			return;
+		default:
+			return;
+	}
+}
+
+/*
+ *     A byte received from the master.
+ */
+void sim_ds18b20::receive(uint8_t data, uint64_t now)
+{
+	switch (_state)
+	{
+		case DS_ROM_COMMAND:
+			_count    = 0;
+			_position = 0;
+			_phase    = 0;
+			if      (data == CMD_READ_ROM)     send(rom, 8, DS_FUNCTION);
+			else if (data == CMD_MATCH_ROM)    _state = DS_MATCH;
+			else if (data == CMD_SKIP_ROM)     _state = DS_FUNCTION;
+			else if (data == CMD_SEARCH_ROM)   _state = DS_SEARCH;
+			else if (data == CMD_ALARM_SEARCH) _state = _alarm ? DS_SEARCH : DS_IDLE;
+			else                               _state = DS_IDLE;
+			return;
+
+		case DS_MATCH:
+			if (data != rom[_count]) _state = DS_IDLE;
+			else if (++_count == 8)  _state = DS_FUNCTION;
+			return;
+
+		case DS_FUNCTION:
+			_count = 0;
+			switch (data)
+			{
+				case CMD_CONVERT_TEMP:
+					_converting = true;
+					_busy_until = now + (DS18B20_9BIT_TIME << ((scratchpad[4] >> 5) & 0x03));
+					_state      = DS_BUSY;
+					return;
+				case CMD_READ_SCRATCHPAD:
+					send(scratchpad, 9, DS_IDLE);
+					return;
+				case CMD_WRITE_SCRATCHPAD:
+					_state = DS_WRITE;
+					return;
+				case CMD_COPY_SCRATCHPAD:
+					for (uint8_t i = 0; i < 3; i++) eeprom[i] = scratchpad[i + 2];
+					_busy_until = now + DS18B20_COPY_TIME;
+					_state      = DS_BUSY;
+					return;
+				case CMD_RECALL_E2:
+					for (uint8_t i = 0; i < 3; i++) scratchpad[i + 2] = eeprom[i];
+					scratchpad[8] = sim_crc8(scratchpad, 8);
+					_busy_until = now;
+					_state      = DS_BUSY;
+					return;
+				case CMD_READ_POWER:						//  externally powered, all read slots are 1
+				default:
+					_state = DS_IDLE;
+					return;
+			}
+
+		case DS_WRITE:
+			if (_count == 2) data = (data & 0x60) | 0x1F;			//  only the resolution bits are writable
+			scratchpad[2 + _count] = data;
+			scratchpad[8] = sim_crc8(scratchpad, 8);
+			if (++_count == 3) _state = DS_IDLE;
+			return;
+
+		default:
+			return;
+	}
+}
@@ -58,8 +58,32 @@
 #define F_CPU 16000000ul
 #endif
 
+/*
+ *     Define F_TWI_LCD to run the display at a different SCL frequency than the
+ *     rest of the bus, f.ex. 400000ul. If it is not defined, the display uses the
+ *     default TWI frequency.
+ */
+//  #define F_TWI_LCD 400000ul
+
+/*
+ *     Define LCD_BUSY_FLAG to read the display's busy flag instead of waiting a fixed
+ *     time after each instruction. Clear display and return home then return at once, 
+ *     and the next instruction waits only as long as the display is actually busy.
+ *     Other instructions don't wait at all, since transmitting the next instruction 
+ *     takes longer than the 39us they need at SCL frequencies of up to 400kHz.
+ *     This requires an interface that connects the R/W pin of the display, which the
+ *     common PCF8574 backpack does.
+ */
+//  #define LCD_BUSY_FLAG
+
+#ifndef LCD_BUSY_POLLS
+#define LCD_BUSY_POLLS    16			//  give up waiting after this many reads of the busy flag
+#endif
+
 #include <util/delay.h>
+#include "hal.h"
 #include "twi.h"
+#include "prof.h"
 #include "lcd.h"
 
 
@@ -69,22 +93,109 @@
 #define LCD_ENABLE        0x04
 #define LCD_DISABLE       0xFB
 #define LCD_BACKLIGHT     0x08
+#define LCD_READ          0x02			//  the R/W pin
+#define LCD_BUSY          0x80			//  the busy flag is D7
+#define LCD_SLOW          0x80			//  marks clear display and return home in the deferred queue
+#define LCD_RAW           0x40			//  marks a byte in the deferred queue that is transmitted as it is
 
 /*
  *     definitions of DDRAM addresses
  */
 
 #define LCD_LINE_SIZE         0x40     //  DDRAM address of first char of line 2
+#define LCD_LINE_LENGTH       0x28     //  each line has 40 characters of DDRAM, of which 16 are visible
+#define LCD_CARET_UNKNOWN     0xFF
 
 /*
  *     definitions of commands
  */
 #define CMD_SET_DDRAM_ADDRESS 0x80
+#define CMD_SET_CGRAM_ADDRESS 0x40
 #define CMD_DISPLAY_ON        0x0C
 #define CMD_DISPLAY_OFF       0x08
 #define CMD_CARET_HOME        0x02
 #define CMD_DISPLAY_CLEAR     0x01
 
+/*
+ *     Each byte sent to the display becomes four bytes on the TWI bus: the high 
+ *     nybble with the enable bit set and cleared, then the low nybble the same way.
+ *     Strings are expanded into this buffer and transmitted in bursts of up to 
+ *     LCD_BURST_SIZE / 4 characters. One more byte is needed for the final byte 
+ *     that sets the data pins inactive.
+ */
+#ifndef LCD_BURST_SIZE
+#define LCD_BURST_SIZE        64
+#endif
+
+static unsigned char  _lcd_burst[LCD_BURST_SIZE + 1];
+static unsigned char *_lcd_end = _lcd_burst;					//  end of the burst being prepared
+
+/*
+ *     In deferred mode, the display is not kept waiting while clear display or
+ *     return home executes. Instead, the transmission continues with idle bytes
+ *     that don't latch anything, for as long as the instruction takes to execute.
+ *     One byte takes 9 clock cycles, at the SCL frequency the display runs at when
+ *     the queue is drained, see twi_get_speed.
+ */
+#define LCD_SLOW_PAD(scl) ((1530ul - 39ul) * ((scl) / 1000ul) / 9000ul + 1)
+
+/*
+ *     Expand one byte into the four bytes that transmit it to the display.
+ *
+ *     \param *ptr     Where to store the four bytes.
+ *     \param  data    The command or character.
+ *     \param  ctrl    The control nybble, that is backlight and mode.
+ *     \return         Pointer to the byte after the last one stored.
+ *
+ *     Note:  The enable pin has to stay high for at least 450ns. At 100kHz one
+ *            byte takes 90us to transmit, at 400kHz 22.5us, so there is no
+ *            need to wait between the bytes.
+ */
+static unsigned char *lcd_expand(unsigned char *ptr, unsigned char data, unsigned char ctrl)
+{
+	unsigned char nybble = (data & 0xF0) | ctrl;				//  high data nybble
+	*ptr++ = nybble | LCD_ENABLE;
+	*ptr++ = nybble;
+	
+	nybble = (data << 4) | ctrl;						//  low data nybble
+	*ptr++ = nybble | LCD_ENABLE;
+	*ptr++ = nybble;
+	return ptr;
+}
+
+/*
+ *     Add one byte to the burst buffer, transmitting the buffer first if it is full.
+ *     The TWI connection must be open.
+ *
+ *     \param *ptr     Current end of the buffer.
+ *     \param  data    The command or character.
+ *     \param  ctrl    The control nybble, that is backlight and mode.
+ *     \return         The new end of the buffer.
+ */
+static unsigned char *lcd_burst_put(unsigned char *ptr, unsigned char data, unsigned char ctrl)
+{
+	if (ptr + 4 > _lcd_burst + LCD_BURST_SIZE)
+	{
+		twi_write_str(_lcd_burst, ptr - _lcd_burst);
+		ptr = _lcd_burst;
+	}
+	return lcd_expand(ptr, data, ctrl);
+}
+
+/*
+ *     Set all data pins high (inactive) and transmit the rest of the burst buffer.
+ *     The TWI connection must be open.
+ *
+ *     \param *ptr     Current end of the buffer.
+ */
+static void lcd_burst_end(unsigned char *ptr)
+{
+	if (ptr == _lcd_burst) return;
+	*ptr = *(ptr - 1) | 0xF0;
+	ptr++;
+	twi_write_str(_lcd_burst, ptr - _lcd_burst);
+}
+
 
 
 /*
@@ -92,7 +203,26 @@
  *
  *     \param address    i2c address
  */
-LCD::LCD(unsigned char address) : _lcd_backlight{0x00}, _twi_address{address} {}
+LCD::LCD(unsigned char address) : _lcd_backlight{0x00}, _twi_address{address}, _caret{LCD_CARET_UNKNOWN}, _shadow_valid{false}, _busy{false},
+                                   _deferred{false}, _queue_head{0}, _queue_count{0}, _pad{0}
+{
+	reset_frame();
+	
+	for (uint8_t i = 0; i < LCD_GLYPHS; i++)
+	{
+		_glyphs[i] = 0;
+		_glyph_order[i] = i;
+	}
+	
+	_tx.address  = address;
+	_tx.reg      = 0x00;
+	_tx.flags    = TWI_WRITE;
+	_tx.data     = _lcd_burst;
+	_tx.n        = 0;
+	_tx.status   = TWI_IDLE;
+	_tx.callback = &LCD::transmission_done;
+	_tx.lcd      = this;
+}
 				
 /*
  *     Call this before using the display
@@ -100,6 +230,9 @@ LCD::LCD(unsigned char address) : _lcd_backlight{0x00}, _twi_address{address} {}
 void LCD::init()
 {
 	if (!twi_is_enabled()) twi_enable();
+#ifdef F_TWI_LCD
+	twi_set_device_speed(_twi_address, F_TWI_LCD);
+#endif
 	
 		/*  
 		 *    In case this is the first thing that is called in the main program.
@@ -147,10 +280,13 @@ void LCD::init()
 /*
  *     Write 0x00 to DDRAM and set DDRAM address to 0x00 from AC (Address Counter).
  */		
-void LCD::clear() const
+void LCD::clear()
 {
-	transmit(CMD_DISPLAY_CLEAR);
-	_delay_us(1530);
+	transmit(CMD_DISPLAY_CLEAR, true);
+	
+	reset_frame();
+	_caret = 0x00;
+	_shadow_valid = true;
 }
 
 
@@ -159,10 +295,10 @@ void LCD::clear() const
  *     Set DDRAM address to 0x00 from AC and return cursor to its original position 
  *     if shifted. The contents of DDRAM are not changed.
  */
-void LCD::home() const
+void LCD::home()
 {
-	transmit(CMD_CARET_HOME);
-	_delay_us(1530);
+	transmit(CMD_CARET_HOME, true);
+	_caret = 0x00;
 }
 
 
@@ -172,10 +308,10 @@ void LCD::home() const
  *     
  *     \param line     FIRST or SECOND
  */	
-void LCD::line(lcd_line line) const
+void LCD::line(lcd_line line)
 {
 	transmit(CMD_SET_DDRAM_ADDRESS | line * LCD_LINE_SIZE);
-	_delay_us(39);
+	_caret = line * LCD_LINE_SIZE;
 }
 
 /*
@@ -186,11 +322,11 @@ void LCD::line(lcd_line line) const
  *
  *     Note:      If col is larger than 15, it will be set to zero
  */
-void LCD::pos(lcd_line line, uint8_t col) const
+void LCD::pos(lcd_line line, uint8_t col)
 {
 	if (col > 15) col = 0;
 	transmit(CMD_SET_DDRAM_ADDRESS | (line * LCD_LINE_SIZE + col));
-	_delay_us(39);
+	_caret = line * LCD_LINE_SIZE + col;
 }
 
 
@@ -203,6 +339,13 @@ void LCD::backlight(lcd_mode mode)
 {
 	_lcd_backlight = mode * LCD_BACKLIGHT;
 	
+	if (_deferred)
+	{
+		put(_lcd_backlight, LCD_RAW);
+		service();
+		return;
+	}
+	
 	twi_open(_twi_address);
 	twi_write_ch(_lcd_backlight);
 	twi_close();
@@ -216,10 +359,9 @@ void LCD::backlight(lcd_mode mode)
  *
  *     \param mode     ON or OFF
  */ 
-void LCD::display(lcd_mode mode) const
+void LCD::display(lcd_mode mode)
 {
 	transmit(mode * CMD_DISPLAY_ON | !mode * CMD_DISPLAY_OFF);	//  branchless. works because mode is either true or false.
-	_delay_ms(39);
 }
 
 
@@ -241,9 +383,251 @@ void LCD::display(lcd_mode mode) const
  *                sprintf(buffer, "%-16s", "Hello!");			//  format string using sprintf
  *                display.print(buffer);
  */
-void LCD::print(const char *string) const
+void LCD::print(const char *string)
 {
 	transmit(string);
+	
+		//  keep the frame and the shadow in step with the screen
+	for (const char *ptr = string; *ptr != 0; ptr++)
+	{
+		if (_caret == LCD_CARET_UNKNOWN)
+		{
+			_shadow_valid = false;
+			break;
+		}
+		
+		uint8_t row = _caret / LCD_LINE_SIZE;
+		uint8_t col = _caret % LCD_LINE_SIZE;
+		if (col < LCD_COLS) _frame[row][col] = _shadow[row][col] = *ptr;
+		advance_caret();
+	}
+}
+
+
+
+/*
+ *     Draw a string of characters into the frame. Nothing is transmitted
+ *     until flush is called.
+ *
+ *     \param  line      FIRST or SECOND
+ *     \param  col       0 - 15
+ *     \param *string    A pointer to C style string of characters
+ *
+ *     Note:      Characters beyond the end of the line are ignored.
+ */
+void LCD::draw(lcd_line line, uint8_t col, const char *string)
+{
+	while (col < LCD_COLS && *string != 0) _frame[line][col++] = *string++;
+}
+
+
+
+/*
+ *     Draw a single character into the frame, typically a custom character.
+ *
+ *     \param  line      FIRST or SECOND
+ *     \param  col       0 - 15
+ *     \param  c         The character
+ */
+void LCD::draw(lcd_line line, uint8_t col, char c)
+{
+	if (col < LCD_COLS) _frame[line][col] = c;
+}
+
+
+
+/*
+ *     Get the character code of a custom character, uploading the bitmap
+ *     to the display's CGRAM if necessary.
+ *
+ *     \param *bitmap    Pointer to 8 bytes, one for each row of pixels.
+ *     \return           The character code, 0x08 - 0x0F.
+ *
+ *     Note:      If all 8 places hold glyphs that are on the screen, the least
+ *                recently used one is replaced, and the characters on the screen
+ *                that show it will change.
+ */
+char LCD::glyph(const uint8_t *bitmap)
+{
+		//  is the glyph in the display already?
+	uint8_t i = 0;
+	while (i < LCD_GLYPHS && _glyphs[_glyph_order[i]] != bitmap) i++;
+	
+	if (i == LCD_GLYPHS)
+	{
+			//  no. replace the least recently used glyph that isn't on the screen, if any.
+		i = LCD_GLYPHS - 1;
+		while (i > 0 && glyph_on_screen(_glyph_order[i])) i--;
+		if (glyph_on_screen(_glyph_order[i])) i = LCD_GLYPHS - 1;
+		
+		uint8_t slot = _glyph_order[i];
+		_glyphs[slot] = bitmap;
+		
+			//  upload the bitmap, then point the address counter back to DDRAM
+		begin();
+		put(CMD_SET_CGRAM_ADDRESS | (slot << 3), LCD_COMMAND_MODE);
+		for (uint8_t row = 0; row < 8; row++) put(bitmap[row], LCD_DATA_MODE);
+		if (_caret == LCD_CARET_UNKNOWN) _caret = 0x00;
+		put(CMD_SET_DDRAM_ADDRESS | _caret, LCD_COMMAND_MODE);
+		end(false);
+	}
+	
+		//  move the glyph to the front of the list
+	uint8_t slot = _glyph_order[i];
+	for (; i > 0; i--) _glyph_order[i] = _glyph_order[i - 1];
+	_glyph_order[0] = slot;
+	
+	return slot | 0x08;
+}
+
+
+
+/*
+ *     Transmit the characters in the frame that differ from the screen.
+ *     All changes are transmitted in a single TWI connection. The caret
+ *     is only moved when the next changed character isn't at the caret 
+ *     already, and a single unchanged character between two changed ones
+ *     is rewritten rather than jumped over, since this costs the same
+ *     number of bytes on the bus but saves an instruction.
+ *
+ *     Note:      The caret is left after the last character written.
+ */
+void LCD::flush()
+{
+	bool open = false;
+	
+	for (uint8_t row = 0; row < LCD_ROWS; row++)
+	{
+		uint8_t col = 0;
+		while (col < LCD_COLS)
+		{
+				//  skip unchanged characters
+			if (_shadow_valid && _frame[row][col] == _shadow[row][col])
+			{
+				col++;
+				continue;
+			}
+			
+				//  find the end of this run of changed characters, bridging gaps of one character
+			uint8_t end = col + 1;
+			while (end < LCD_COLS)
+			{
+				if (!_shadow_valid || _frame[row][end] != _shadow[row][end]) end++;
+				else if (end + 1 < LCD_COLS && _frame[row][end + 1] != _shadow[row][end + 1]) end += 2;
+				else break;
+			}
+			
+			if (!open)
+			{
+				begin();
+				open = true;
+			}
+			
+				//  move the caret if it isn't there already
+			uint8_t address = row * LCD_LINE_SIZE + col;
+			if (_caret != address) put(CMD_SET_DDRAM_ADDRESS | address, LCD_COMMAND_MODE);
+			
+			for (; col < end; col++)
+			{
+				put(_frame[row][col], LCD_DATA_MODE);
+				_shadow[row][col] = _frame[row][col];
+			}
+			_caret = row * LCD_LINE_SIZE + end;
+		}
+	}
+	_shadow_valid = true;
+	
+	if (open) end(false);
+}
+
+
+
+/*
+ *     Turn deferred mode on or off.
+ *
+ *     \param mode     ON or OFF
+ *
+ *     Note:      Turning deferred mode off waits until the queue has been transmitted.
+ */
+void LCD::defer(lcd_mode mode)
+{
+	if (mode) wait_ready();
+	else while (!service()) HAL_POLL();
+	
+	_deferred = mode;
+}
+
+
+
+/*
+ *     Transmit the next part of the queue in deferred mode, unless the previous
+ *     part is still being transmitted. The callback of the transaction calls 
+ *     this as well, so the queue drains in the background.
+ *
+ *     \return    true if the queue is empty and everything has been transmitted.
+ */
+bool LCD::service()
+{
+	bool idle = false;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)					//  called from the main program and from the ISR
+	{
+		if (_tx.status != TWI_PENDING)
+		{
+			unsigned char *ptr = _lcd_burst;
+			uint8_t head  = _queue_head;
+			uint8_t count = _queue_count;
+			uint8_t pad   = _pad;
+			
+				//  expand as many entries as there is room for, and stop after a slow instruction
+			while (!pad && count && ptr + 4 <= _lcd_burst + LCD_BURST_SIZE)
+			{
+				uint16_t entry = _queue[head];
+				uint8_t  flags = entry >> 8;
+				head = (head + 1) % LCD_QUEUE_SIZE;
+				count--;
+				
+				if (flags & LCD_RAW) *ptr++ = entry & 0xFF;
+				else ptr = lcd_expand(ptr, entry & 0xFF, _lcd_backlight | (flags & LCD_DATA_MODE));
+				if (flags & LCD_SLOW) pad = LCD_SLOW_PAD(twi_get_speed(_twi_address));
+			}
+			
+				//  set all data pins high (inactive), and keep them that way while a slow instruction executes
+			unsigned char inactive = (ptr == _lcd_burst) ? (0xF0 | _lcd_backlight) : (*(ptr - 1) | 0xF0);
+			if (ptr != _lcd_burst) *ptr++ = inactive;
+			while (pad && ptr < _lcd_burst + LCD_BURST_SIZE + 1)
+			{
+				*ptr++ = inactive;
+				pad--;
+			}
+			
+			if (ptr == _lcd_burst) idle = true;
+			else
+			{
+				_tx.n = ptr - _lcd_burst;
+				if (twi_submit(&_tx))					//  if the TWI queue is full, try again next time
+				{
+					_queue_head  = head;
+					_queue_count = count;
+					_pad         = pad;
+				}
+			}
+		}
+	}
+	return idle;
+}
+
+
+
+/*
+ *     Private function called by the TWI ISR when a part of the queue has been
+ *     transmitted.
+ *
+ *     \param *t     The display's transaction.
+ */
+void LCD::transmission_done(twi_transaction *t)
+{
+	static_cast<transaction *>(t)->lcd->service();
 }
 
 		
@@ -266,8 +650,26 @@ void LCD::print(const char *string) const
  */
 void LCD::command(unsigned char command)
 {
-	transmit(command);
-	_delay_us(39);							//  all commands require 39us, except clear display and return home
+	transmit(command, command != 0x00 && command < 0x04);		//  all commands require 39us, except clear display and return home
+	
+		//  keep track of the caret and the screen contents
+	if (command & CMD_SET_DDRAM_ADDRESS) _caret = command & 0x7F;
+	else if (command == CMD_DISPLAY_CLEAR)
+	{
+		reset_frame();
+		_caret = 0x00;
+	}
+	else if ((command & 0xFE) == CMD_CARET_HOME)
+	{
+		_caret = 0x00;
+	}
+	else if ((command & 0xC0) == 0x40 ||				//  set CGRAM address ...
+		 (command & 0xF0) == 0x10 ||				//  ... cursor or display shift ...
+		 ((command & 0xFC) == 0x04 && command != 0x06))		//  ... or an entry mode other than the default
+	{
+		_caret = LCD_CARET_UNKNOWN;
+		_shadow_valid = false;
+	}
 }
 
 
@@ -298,25 +700,15 @@ void LCD::latch_data(const unsigned char data) const
  *     at the time.
  *
  *    \param data     Data to write to the display
+ *    \param slow     true for clear display and return home
  */	
-void LCD::transmit(const unsigned char data) const
+void LCD::transmit(const unsigned char data, bool slow)
 {
-	twi_open(_twi_address);
-		
-		//  prepare command part of data nybble	
-	unsigned char cmd  = _lcd_backlight | LCD_COMMAND_MODE;
-	
-		//  prepare high data nybble	
-	cmd = (data & 0xF0) | _lcd_backlight;	
-	latch_data(cmd);	
-	
-		//  prepare low data nybble	
-	cmd = (data << 4) | _lcd_backlight;	
-	latch_data(cmd);	
-	
-		//  set all data pins high (inactive) and close TWI connection	
-	twi_write_ch(cmd | 0xF0);
-	twi_close();	
+	PROF_START(t);
+	begin();
+	put(data, LCD_COMMAND_MODE | (slow ? LCD_SLOW : 0));
+	end(slow);
+	PROF_STOP(PROF_LCD, t);
 }
 
 
@@ -328,26 +720,191 @@ void LCD::transmit(const unsigned char data) const
  *     \param *data     Pointer to first character of zero terminated 
  *                      data string.
  */
-void LCD::transmit(const char *data) const
+void LCD::transmit(const char *data)
 {
-	twi_open(_twi_address);
+	if (*data == 0) return;
+	
+	PROF_START(t);
+	begin();
+	while (*data != 0) put(*data++, LCD_DATA_MODE);
+	end(false);
+	PROF_STOP(PROF_LCD, t);
+}
+
+
+
+/*
+ *     Private function to start a transmission. Opens the TWI connection,
+ *     unless in deferred mode.
+ */
+void LCD::begin()
+{
+	if (_deferred) return;
 	
-		//  prepare command nybble
-	unsigned char ctrl = _lcd_backlight | LCD_DATA_MODE;
-	unsigned char cmd  = 0x00;
+	wait_ready();
+	twi_open(_twi_address);
+	_lcd_end = _lcd_burst;
+}
+
+
+
+/*
+ *     Private function to add one command or character to the transmission.
+ *     In deferred mode, it is added to the queue.
+ *
+ *     \param data     The command or character.
+ *     \param flags    LCD_COMMAND_MODE or LCD_DATA_MODE, and LCD_SLOW for
+ *                     clear display and return home.
+ */
+void LCD::put(unsigned char data, unsigned char flags)
+{
+	if (!_deferred)
+	{
+		_lcd_end = lcd_burst_put(_lcd_end, data, _lcd_backlight | (flags & LCD_DATA_MODE));
+		return;
+	}
 	
-	while (*data != 0)
+	while (_queue_count == LCD_QUEUE_SIZE)					//  wait for room in the queue
 	{
-			//  prepare high data nybble
-		cmd = (*data & 0xF0) | ctrl;				//  mask low data nybble and OR in control nybble			
-		latch_data(cmd);
-		
-			//  prepare low data nybble			//  shift low data into position and OR in control nybble
-		cmd = (*data++ << 4) | ctrl;			
-		latch_data(cmd);			
+		service();
+		HAL_POLL();
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_queue[(_queue_head + _queue_count) % LCD_QUEUE_SIZE] = (flags << 8) | data;
+		_queue_count++;
 	}
-		//  set all data pins high (inactive) and close i2c connection	
-	twi_write_ch(cmd | 0xF0);
+}
+
+
+
+/*
+ *     Private function to end a transmission. Transmits the rest of the burst
+ *     and waits for the last instruction to execute. In deferred mode, the
+ *     queue is serviced instead, which starts the transmission if the bus is idle.
+ *
+ *     \param slow     true if the last instruction is clear display or return home.
+ */
+void LCD::end(bool slow)
+{
+	if (_deferred)
+	{
+		service();
+		return;
+	}
+	
+		//  set all data pins high (inactive), transmit and close i2c connection
+	lcd_burst_end(_lcd_end);
 	twi_close();
-	_delay_us(37);
+	instruction_wait(slow);
+}
+
+
+
+/*
+ *     Private function called after an instruction has been transmitted. 
+ *     Waits for the instruction to execute, or, with LCD_BUSY_FLAG, takes
+ *     note of a slow instruction so that the next transmission waits for 
+ *     the busy flag.
+ *
+ *     \param slow     true for clear display and return home (1.53ms),
+ *                     false for all other instructions (39us).
+ */
+void LCD::instruction_wait(bool slow)
+{
+#ifdef LCD_BUSY_FLAG
+	_busy = slow;
+#else
+	if (slow) _delay_us(1530);
+	else      _delay_us(39);
+#endif
+}
+
+
+
+/*
+ *     Private function that waits until the display is ready, if a slow 
+ *     instruction may still be executing. Does nothing without LCD_BUSY_FLAG.
+ *
+ *     Note:  The busy flag is read in 4-bit mode. With R/W high, the data pins
+ *            are set high to release them to the display. Raising the enable 
+ *            pin puts the busy flag and bits 6 - 4 of the address counter on 
+ *            the data pins, where it is read by the TWI interface. The low nybble 
+ *            is clocked out with a second pulse and ignored.
+ */
+void LCD::wait_ready()
+{
+#ifdef LCD_BUSY_FLAG
+	if (!_busy) return;
+	_busy = false;
+	
+	unsigned char ctrl = 0xF0 | _lcd_backlight | LCD_READ | LCD_COMMAND_MODE;
+	unsigned char status = LCD_BUSY;
+	
+	for (uint8_t n = 0; n < LCD_BUSY_POLLS && (status & LCD_BUSY); n++)
+	{
+		twi_open(_twi_address);
+		twi_write_ch(ctrl);
+		twi_write_ch(ctrl | LCD_ENABLE);				//  high nybble on the data pins
+		twi_open_read(_twi_address);					//  repeated start, read the pins
+		twi_receive_ch(&status, 0);
+		twi_open(_twi_address);						//  repeated start
+		twi_write_ch(ctrl);
+		twi_write_ch(ctrl | LCD_ENABLE);				//  low nybble, ignored
+		twi_write_ch(ctrl);
+		twi_close();
+	}
+#endif
+}
+
+
+
+/*
+ *     Private function to fill the frame and the shadow with blanks, which
+ *     is what the screen shows after it has been cleared.
+ */
+void LCD::reset_frame()
+{
+	for (uint8_t row = 0; row < LCD_ROWS; row++)
+	{
+		for (uint8_t col = 0; col < LCD_COLS; col++) _frame[row][col] = _shadow[row][col] = ' ';
+	}
+}
+
+
+
+/*
+ *     Private function to check if a custom character is on the screen, or
+ *     will be after the next flush. The character codes 0x00 - 0x07 and
+ *     0x08 - 0x0F both show the 8 custom characters.
+ *
+ *     \param slot     CGRAM place, 0 - 7
+ *     \return         true if the character is in use.
+ */
+bool LCD::glyph_on_screen(uint8_t slot) const
+{
+	for (uint8_t row = 0; row < LCD_ROWS; row++)
+	{
+		for (uint8_t col = 0; col < LCD_COLS; col++)
+		{
+			if ((_frame[row][col] & 0xF7) == slot || (_shadow[row][col] & 0xF7) == slot) return true;
+		}
+	}
+	return false;
+}
+
+
+
+/*
+ *     Private function to move the caret one position after a character has
+ *     been written. The 40 characters of the first line continue on the second
+ *     line and the second line continues on the first.
+ */
+void LCD::advance_caret()
+{
+	if (_caret == LCD_CARET_UNKNOWN) return;
+	
+	_caret++;
+	if (_caret == LCD_LINE_LENGTH) _caret = LCD_LINE_SIZE;
+	else if (_caret == LCD_LINE_SIZE + LCD_LINE_LENGTH) _caret = 0x00;
 }
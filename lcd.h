@@ -21,7 +21,8 @@
  *          util/delay.h: After transmitting an instruction to the display, the program will
  *                        wait for 39us or 1.53ms while the instruction executes. Failure to
  *                        this will almost certainly cause errors. This library is provided
- *                        by AtmelStudio.
+ *                        by AtmelStudio. If LCD_BUSY_FLAG is defined, the display's busy flag
+ *                        is read instead, see lcd.cpp.
  *          stdint.h      This library uses data types defined in this header. stdint.h is
  *                        part of the C standard library.
  *          twi.h:        This library is designed to work with an TWI interface.
@@ -54,7 +55,16 @@
 #define SHIFT_DISPLAY_LEFT  0x1C			//  text moves right
 #define SHIFT_DISPLAY_RIGHT 0x18			//  text moves left
 
+#define LCD_COLS            16
+#define LCD_ROWS            2
+#define LCD_GLYPHS          8			//  number of custom characters the display can hold
+
+#ifndef LCD_QUEUE_SIZE
+#define LCD_QUEUE_SIZE      48			//  number of commands and characters that can wait in deferred mode
+#endif
+
 #include <stdint.h>
+#include "twi.h"
 
 enum lcd_mode : bool    {OFF = false, ON = true};
 enum lcd_line : uint8_t {FIRST = 0, SECOND = 1};
@@ -84,13 +94,13 @@ class LCD
 		 *     at least by the author. For more exotic functionality, consider the 
 		 *     command function with the macros defined at the top of this file.
 		 */       
-		void clear() const;								//  clears the display or screen
-		void home() const;								//  sets the caret in the first position of the first line
-		void line(lcd_line line) const;							//  sets the caret in the first position of the given line (FIRST or SECOND)
-		void pos(lcd_line line, uint8_t col) const;					//  sets the caret in the position indicated by col (0 - 15) of the given line
+		void clear();									//  clears the display or screen
+		void home();									//  sets the caret in the first position of the first line
+		void line(lcd_line line);							//  sets the caret in the first position of the given line (FIRST or SECOND)
+		void pos(lcd_line line, uint8_t col);						//  sets the caret in the position indicated by col (0 - 15) of the given line
 		
 		void backlight(lcd_mode mode = ON);						//  turns the backlight ON or OFF (ON is default)
-		void display(lcd_mode mode = ON) const;						//  turns the display ON or OFF (ON is default)
+		void display(lcd_mode mode = ON);						//  turns the display ON or OFF (ON is default)
 		
 		/*
 		 *     This function prints a string of characters at the current caret position.
@@ -102,7 +112,71 @@ class LCD
 		 *     lcd.line(SECOND);							//  caret to first position, bottom line
 		 *     lcd.print(buffer);							//  call the display function to print the string
 		 */
-		void print(const char *string) const;
+		void print(const char *string);
+		
+		/*
+		 *     The display class keeps a copy of the characters on the screen. Instead of
+		 *     positioning the caret and printing, text can be drawn into a frame that is
+		 *     transmitted by flush. flush only transmits the characters that differ from
+		 *     what is already on the screen, so a frame can be redrawn in its entirety 
+		 *     as often as needed without wasting time on the bus.
+		 *     For example, to update a clock every 100ms, do something like this:
+		 *     lcd.draw(SECOND, 4, buffer);						//  draw the time into the frame
+		 *     lcd.flush();								//  only the digits that changed are transmitted
+		 *
+		 *     Note:  draw does not wrap. Characters beyond the end of the line are ignored.
+		 *
+		 *     Note:  The copy assumes the default entry mode, that is the caret moves to 
+		 *            the right. Commands that move the caret or shift the display in other
+		 *            ways make flush rewrite the entire frame.
+		 */
+		void draw(lcd_line line, uint8_t col, const char *string);
+		void draw(lcd_line line, uint8_t col, char c);
+		void flush();
+		
+		/*
+		 *     The display can hold 8 custom characters, or glyphs, of 5x8 pixels. glyph
+		 *     returns the character code of a glyph, and uploads the glyph to the display
+		 *     if it isn't there already. When all 8 places are taken, the least recently
+		 *     used glyph that isn't on the screen is replaced. The character code can be 
+		 *     printed or drawn like any other character.
+		 *     For example, to draw a degree symbol:
+		 *     static const uint8_t degree[8] = {0x06, 0x09, 0x09, 0x06, 0x00, 0x00, 0x00, 0x00};
+		 *     lcd.draw(FIRST, 15, lcd.glyph(degree));
+		 *     lcd.flush();
+		 *
+		 *     Note:  Each byte of the bitmap is one row of pixels, top row first. Only the 
+		 *            5 least significant bits are used.
+		 *
+		 *     Note:  A glyph is recognized by the address of its bitmap, so bitmaps should
+		 *            be static and never change.
+		 *
+		 *     Note:  The character codes are 0x08 - 0x0F, so they can be used in strings.
+		 */
+		char glyph(const uint8_t *bitmap);
+		
+		/*
+		 *     In deferred mode, print, pos, line, clear, home, display, command and flush
+		 *     don't wait for the display. The commands and characters are put in a queue
+		 *     and the functions return immediately. The queue is transmitted in the 
+		 *     background by the TWI interrupt service routine, taking the execution time 
+		 *     of each instruction into account. For example:
+		 *     lcd.defer(ON);								//  from now on, don't wait
+		 *     lcd.draw(SECOND, 4, buffer);
+		 *     lcd.flush();								//  returns at once
+		 *
+		 *     service returns true when everything has been transmitted. Call it now and
+		 *     then from the main loop. It is only needed if a transmission could not be 
+		 *     queued because the TWI queue was full.
+		 *
+		 *     Note:  Global interrupts must be enabled in deferred mode. If the queue is
+		 *            full, the functions wait for room in the queue.
+		 *
+		 *     Note:  The backlight bit is part of every byte transmitted, so a change
+		 *            of backlight also applies to what is already in the queue.
+		 */
+		void defer(lcd_mode mode = ON);
+		bool service();
 		
 		/*
 		 *     The following function accepts custom instructions and commands defined at the top of
@@ -115,9 +189,42 @@ class LCD
 		void command(unsigned char command);
 	private:
 		void latch_data(const unsigned char data) const;	
-		void transmit(const unsigned char data) const;					//  transmits display commands
-		void transmit(const char *data) const;						//  transmits data
+		void transmit(const unsigned char data, bool slow = false);			//  transmits display commands
+		void transmit(const char *data);						//  transmits data
+		void begin();									//  starts a transmission
+		void put(unsigned char data, unsigned char flags);				//  adds a command or a character to the transmission
+		void end(bool slow);								//  ends the transmission
+		void instruction_wait(bool slow);						//  waits for, or takes note of, the instruction just transmitted
+		void wait_ready();								//  polls the busy flag if a slow instruction is executing
+		void reset_frame();								//  fills frame and shadow with blanks
+		bool glyph_on_screen(uint8_t slot) const;					//  checks if a custom character is in use
+		void advance_caret();								//  keeps track of the caret after a character is written
 				
 		unsigned char _lcd_backlight;
 		unsigned char _twi_address;
+		
+		char          _frame[LCD_ROWS][LCD_COLS];					//  what the screen should show
+		char          _shadow[LCD_ROWS][LCD_COLS];					//  what the screen shows
+		uint8_t       _caret;								//  DDRAM address of the caret, LCD_CARET_UNKNOWN if not known
+		
+		const uint8_t *_glyphs[LCD_GLYPHS];						//  bitmap in each CGRAM place, 0 if empty
+		uint8_t        _glyph_order[LCD_GLYPHS];					//  CGRAM places, most recently used first
+		bool          _shadow_valid;							//  false if the screen contents are unknown
+		bool          _busy;								//  a slow instruction may still be executing (only with LCD_BUSY_FLAG)
+		
+		/*
+		 *     Deferred mode. _queue holds commands and characters in the low byte and
+		 *     flags in the high byte. _pad counts idle bytes still to be transmitted
+		 *     while a slow instruction executes. The transaction carries a pointer to
+		 *     the display, so its callback can transmit the next part of the queue.
+		 */
+		struct transaction : twi_transaction { LCD *lcd; };
+		static void transmission_done(twi_transaction *t);
+		
+		bool              _deferred;
+		uint16_t          _queue[LCD_QUEUE_SIZE];
+		volatile uint8_t  _queue_head;
+		volatile uint8_t  _queue_count;
+		uint8_t           _pad;
+		transaction       _tx;
 };
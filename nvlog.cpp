@@ -0,0 +1,200 @@
+/*
+ * nvlog.cpp
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To keep a log of temperature readings in the battery backed RAM of a DS1307.
+ *
+ * Dependencies:
+ *
+ *          nvlog.h
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "nvlog.h"
+
+
+/*
+ *     The magic number depends on the record size, so a log written in another 
+ *     format is not mistaken for a valid log.
+ */
+#define NVLOG_MAGIC (0xA0 | NVLOG_RECORD_SIZE)
+
+
+/*
+ *     Constructor
+ *
+ *     \param &clock    The DS1307 that stores the log.
+ *     \param addr      First byte of the log in the DS1307 RAM, 0 - 55.
+ *     \param size      Number of bytes of RAM used by the log.
+ *
+ *     Note:  Call begin() before using the log.
+ */
+NVLog::NVLog(DS1307 &clock, uint8_t addr, uint8_t size) : _clock(clock), _addr(addr)
+{
+	if (addr + size > DS1307_NVRAM_SIZE) size = DS1307_NVRAM_SIZE - addr;
+	_capacity = (size > NVLOG_HEADER_SIZE) ? (size - NVLOG_HEADER_SIZE) / NVLOG_RECORD_SIZE : 0;
+	_head  = 0;
+	_count = 0;
+	_last  = 0;
+}
+
+/*
+ *     Read the log header from the DS1307 RAM. If the RAM does not contain a 
+ *     valid log, f.ex. after the backup battery was replaced, the log is cleared.
+ *
+ *     \return     False if the DS1307 did not respond.
+ */
+bool NVLog::begin()
+{
+	uint8_t header[NVLOG_HEADER_SIZE];
+	
+	if (!_clock.read_nvram(_addr, header, NVLOG_HEADER_SIZE)) return false;
+	if (header[0] != NVLOG_MAGIC || header[1] >= _capacity || header[2] > _capacity) return clear();
+	
+	_head  = header[1];
+	_count = header[2];
+	_last  = (uint32_t)header[3] | ((uint32_t)header[4] << 8) | ((uint32_t)header[5] << 16) | ((uint32_t)header[6] << 24);
+	return true;
+}
+
+/*
+ *     Remove all readings from the log.
+ *
+ *     \return     False if the DS1307 did not respond.
+ */
+bool NVLog::clear()
+{
+	_head  = 0;
+	_count = 0;
+	_last  = 0;
+	return write_header();
+}
+
+/*
+ *     Add a reading to the log. If the log is full, the oldest reading is 
+ *     overwritten. The reading is written before the header, so if power 
+ *     is lost in between, the log still holds the previous readings.
+ *
+ *     \param t        Time of the reading, seconds since 01.01.2000.
+ *     \param temp     Temperature in 1/16 degrees.
+ *     \return         False if the DS1307 did not respond.
+ */
+bool NVLog::append(uint32_t t, int16_t temp)
+{
+	uint8_t  record[NVLOG_RECORD_SIZE];
+	uint32_t delta = 0;
+	
+	if (!_capacity) return false;
+	if (_count && t > _last) delta = t - _last;
+	if (delta > NVLOG_MAX_DELTA) delta = NVLOG_MAX_DELTA;
+	
+		//  12 bits temperature, 12 bits delta
+	record[0] = (uint8_t)temp;
+	record[1] = (uint8_t)((temp >> 8) & 0x0F) | (uint8_t)((delta & 0x0F) << 4);
+	record[2] = (uint8_t)(delta >> 4);
+	
+	if (!_clock.write_nvram(_addr + NVLOG_HEADER_SIZE + _head * NVLOG_RECORD_SIZE, record, NVLOG_RECORD_SIZE)) return false;
+	
+	if (++_head == _capacity) _head = 0;
+	if (_count < _capacity) _count++;
+	_last = t;
+	return write_header();
+}
+
+/*
+ *     Read the readings in the log, newest first. All the readings are read 
+ *     from the DS1307 in one transaction.
+ *
+ *     \param *temp    Buffer for n temperatures, in 1/16 degrees.
+ *     \param *t       Buffer for n timestamps, seconds since 01.01.2000.
+ *     \param n        Size of the buffers.
+ *     \return         Number of readings, 0 if the log is empty or the DS1307 did not respond.
+ */
+uint8_t NVLog::restore(int16_t *temp, uint32_t *t, uint8_t n) const
+{
+	uint8_t  data[DS1307_NVRAM_SIZE];
+	uint8_t  index = _head;
+	uint32_t time  = _last;
+	
+	if (n > _count) n = _count;
+	if (!n) return 0;
+	if (!_clock.read_nvram(_addr + NVLOG_HEADER_SIZE, data, _capacity * NVLOG_RECORD_SIZE)) return 0;
+	
+	for (uint8_t i = 0; i < n; i++)
+	{
+		index = (index ? index : _capacity) - 1;				//  step backwards, wrapping around
+		const uint8_t *record = data + index * NVLOG_RECORD_SIZE;
+		
+			//  sign extend the 12 bit temperature
+		int16_t value = record[0] | ((record[1] & 0x0F) << 8);
+		if (value & 0x0800) value |= 0xF000;
+		
+		temp[i] = value;
+		t[i]    = time;
+		time   -= (record[1] >> 4) | ((uint16_t)record[2] << 4);		//  the previous reading was delta seconds earlier
+	}
+	return n;
+}
+
+/*
+ *     Get the number of readings in the log.
+ */
+uint8_t NVLog::count() const
+{
+	return _count;
+}
+
+/*
+ *     Get the number of readings the log can hold.
+ */
+uint8_t NVLog::capacity() const
+{
+	return _capacity;
+}
+
+/*
+ *     Get the timestamp of the newest reading, in seconds since 01.01.2000. 
+ *     0 if the log is empty.
+ */
+uint32_t NVLog::last_time() const
+{
+	return _last;
+}
+
+/*
+ *     Private function to write the header, including the magic number, in 
+ *     one transaction.
+ *
+ *     \return     False if the DS1307 did not respond.
+ */
+bool NVLog::write_header() const
+{
+	uint8_t header[NVLOG_HEADER_SIZE] = {NVLOG_MAGIC, _head, _count, 
+	                                     (uint8_t)_last, (uint8_t)(_last >> 8), (uint8_t)(_last >> 16), (uint8_t)(_last >> 24)};
+	
+	return _clock.write_nvram(_addr, header, NVLOG_HEADER_SIZE);
+}
@@ -0,0 +1,125 @@
+/*
+ * nvlog.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To keep a log of temperature readings in the battery backed RAM of a DS1307, 
+ *          so the most recent readings survive a power cycle without an external EEPROM.
+ *
+ *          The log is a ring buffer. When it is full, the oldest reading is overwritten.
+ *          Each reading takes 3 bytes: the temperature in 1/16 degrees, as read by 
+ *          ds18b20_read_temp_fixed, and the number of seconds since the previous reading, 
+ *          12 bits each. Only the timestamp of the newest reading is stored in full, as 
+ *          seconds since 01.01.2000 (see DS1307::get_epoch), so the timestamps of the older 
+ *          readings are found by counting backwards. With the whole RAM, the log holds 16 
+ *          readings.
+ *
+ *          Layout, starting at the first byte of the log:
+ *
+ *          0       magic number, identifies a valid log
+ *          1       index of the next reading to be written
+ *          2       number of readings in the log
+ *          3 - 6   timestamp of the newest reading, least significant byte first
+ *          7 -     readings, 3 bytes each
+ *
+ * Limitations:
+ *
+ *          Temperatures must be in the range -128 to 127.9375 degrees, which covers the 
+ *          DS18B20. Readings more than 4095 seconds apart are stored as 4095 seconds apart, 
+ *          so the timestamps of the readings before such a gap are too late. 
+ *
+ * Example:
+ *
+ *          DS1307 clock;
+ *          NVLog  log(clock);
+ *          
+ *          clock.init();
+ *          log.begin();                              //  restores the log, or clears it if there is none
+ *          n = log.restore(temp, time, 16);          //  the last readings, newest first
+ *          ...
+ *          log.append(clock.get_epoch(), thermo.temp);
+ *
+ * Dependencies:
+ *
+ *          stdint.h:     This library uses fixed width integer types.
+ *          ds1307.h:     The log is stored in the DS1307 RAM.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "ds1307.h"
+
+#define NVLOG_HEADER_SIZE  7
+#define NVLOG_RECORD_SIZE  3
+#define NVLOG_MAX_DELTA    0x0FFF						//  largest time between readings, in seconds
+
+class NVLog
+{
+	public:
+		/*
+		 *     The log uses size bytes of the DS1307 RAM, starting at addr (0 - 55). 
+		 *     The default is to use all of it. The size must leave room for at least 
+		 *     one reading.
+		 */
+		NVLog(DS1307 &clock, uint8_t addr = 0, uint8_t size = DS1307_NVRAM_SIZE);
+		
+		/*
+		 *     begin() reads the log from the RAM, or clears it if the RAM does not 
+		 *     contain a valid log. clear() removes all readings.
+		 */
+		bool begin();
+		bool clear();
+		
+		/*
+		 *     Add a reading, t is the time in seconds since 01.01.2000. Readings 
+		 *     must be appended in order.
+		 */
+		bool append(uint32_t t, int16_t temp);
+		
+		/*
+		 *     Read up to n readings into temp and t, newest first, in one transaction. 
+		 *     Returns the number of readings, 0 if the DS1307 did not respond.
+		 */
+		uint8_t restore(int16_t *temp, uint32_t *t, uint8_t n) const;
+		
+		/*
+		 *     Functions to get information about the log
+		 */
+		uint8_t count() const;
+		uint8_t capacity() const;
+		uint32_t last_time() const;						//  timestamp of the newest reading
+		
+	private:
+		bool write_header() const;
+		
+		DS1307  &_clock;
+		uint8_t  _addr;								//  first byte of the log in RAM
+		uint8_t  _capacity;							//  number of readings that fit
+		uint8_t  _head;								//  index of the next reading
+		uint8_t  _count;							//  number of readings
+		uint32_t _last;								//  timestamp of the newest reading
+};
@@ -55,7 +55,8 @@
 #endif
 
 #include <util/delay.h>
-#include <avr/io.h>
+#include "hal.h"
+#include "prof.h"
 #include "onewire.h"
 
 
@@ -66,11 +67,48 @@
  *     The default owi pin is PB0, that is pin 14 on an AtMega328. If you
  *     want to use a different port, change the following macros accordingly
  */
+#ifndef OWI_MULTI_BUS
 #define OWI_PORT		PORTB
 #define OWI_DDR			DDRB
 #define OWI_PIN         	PINB
 #define OWI_PINMASK		0x01
-#define OWI_IPINMASK		0xFE					//  inverted pin mask
+
+/*
+ *     Without OWI_MULTI_BUS, there is one bus, number 0.
+ */
+#define OWI_BUSES(X)		X(0, OWI_PORT, OWI_DDR, OWI_PIN, OWI_PINMASK)
+#define OWI_SELECTED_BUS	0
+
+#else
+
+/*
+ *     With OWI_MULTI_BUS, the buses are listed in OWI_BUSES, see onewire.h.
+ */
+#ifdef OWI_UART
+#error "OWI_MULTI_BUS needs the port pin backend, OWI_UART has one bus on USART0"
+#endif
+
+static uint8_t _owi_bus = 0;
+#define OWI_SELECTED_BUS	_owi_bus
+#endif
+
+/*
+ *     If OWI_UART is defined, the time slots are generated by USART0 instead,
+ *     with TXD (PD1) and RXD (PD0) joined to the bus through an open drain driver.
+ *     The reset pulse is a 0xF0 byte at 9600 baud, and each bit slot is one byte 
+ *     at 115200 baud, 0xFF to write a 1 or read, and 0x00 to write a 0. The byte
+ *     received is the echo of the line, changed by any slave that pulled it low.
+ *     The USART runs in double speed mode.
+ */
+#define OWI_UBRR_RESET		(F_CPU / 8 / 9600 - 1)
+#define OWI_UBRR_BIT		(F_CPU / 8 / 115200 - 1)
+
+/*
+ *     At overdrive speed, the reset pulse is a 0xE0 byte at 115200 baud, and
+ *     each bit slot is one byte at 1000000 baud.
+ */
+#define OWI_UBRR_OD_RESET	(F_CPU / 8 / 115200 - 1)
+#define OWI_UBRR_OD_BIT		(F_CPU / 8 / 1000000 - 1)
 
 /*
  *     When a system is initially powered up, the master must identify the ROM codes
@@ -119,12 +157,138 @@
  */
 #define OWI_ALARM_SEARCH	0xEC
 
+/*
+ *     The overdrive skip ROM command, sent at standard speed, puts all overdrive 
+ *     capable devices in overdrive mode. The overdrive match ROM command is sent 
+ *     at standard speed, followed by the ROM code at overdrive speed, and puts 
+ *     only that device in overdrive mode. A device leaves overdrive mode on a 
+ *     reset pulse of standard length.
+ */
+#define OWI_OVERDRIVE_SKIP_ROM	0x3C
+#define OWI_OVERDRIVE_MATCH_ROM	0x69
+
+/*
+ *     Choose how the CRC is calculated:
+ *     256:  a 256 byte lookup table in flash, one lookup per byte. Fastest.
+ *     16:   a 16 byte lookup table in flash, two lookups per byte.
+ *     0:    a loop over the 8 bits of each byte, no table. Smallest.
+ */
+#ifndef OWI_CRC_TABLE
+#define OWI_CRC_TABLE		16
+#endif
+
+
+
+/*
+ *     The state of a search. rom holds the ROM code of the last device found,
+ *     last_discrepancy the bit position, 1 - 64, where the search took the 0
+ *     branch the last time there was a choice, and done is set when the last
+ *     device has been found.
+ */
+struct owi_search_state
+{
+	uint8_t rom[8];
+	uint8_t last_discrepancy;
+	uint8_t done;
+};
+
+static struct owi_search_state _owi_search;
+static struct owi_search_state _owi_alarm;
+
+/*
+ *     The current bus speed, OWI_STANDARD or OWI_OVERDRIVE.
+ */
+static uint8_t _owi_speed = OWI_STANDARD;
+
+/*
+ *     Family codes of devices that support overdrive speed. This is not a
+ *     complete list.
+ */
+static const uint8_t _owi_overdrive_families[] = 
+{
+	0x01,								//  DS2401 silicon serial number
+	0x0C,								//  DS1996 memory iButton
+	0x14,								//  DS2430A EEPROM
+	0x1D,								//  DS2423 counter
+	0x23,								//  DS2433 EEPROM
+	0x2D,								//  DS2431 EEPROM
+	0x33,								//  DS2432 secure EEPROM
+	0x37,								//  DS1977 password protected EEPROM
+	0x43								//  DS28EC20 EEPROM
+};
+
 
 
 /*
  *     Static functions are only visible to other functions in this file.
  */
 
+#if OWI_CRC_TABLE == 256
+/*
+ *     The CRC of each byte value with 0 as initial value. Since the CRC is linear,
+ *     the CRC of a byte with any initial value is the table entry of the two xor'ed.
+ */
+static const uint8_t _owi_crc_table[256] PROGMEM =
+{
+	0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
+	0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
+	0x9D, 0xC3, 0x21, 0x7F, 0xFC, 0xA2, 0x40, 0x1E,
+	0x5F, 0x01, 0xE3, 0xBD, 0x3E, 0x60, 0x82, 0xDC,
+	0x23, 0x7D, 0x9F, 0xC1, 0x42, 0x1C, 0xFE, 0xA0,
+	0xE1, 0xBF, 0x5D, 0x03, 0x80, 0xDE, 0x3C, 0x62,
+	0xBE, 0xE0, 0x02, 0x5C, 0xDF, 0x81, 0x63, 0x3D,
+	0x7C, 0x22, 0xC0, 0x9E, 0x1D, 0x43, 0xA1, 0xFF,
+	0x46, 0x18, 0xFA, 0xA4, 0x27, 0x79, 0x9B, 0xC5,
+	0x84, 0xDA, 0x38, 0x66, 0xE5, 0xBB, 0x59, 0x07,
+	0xDB, 0x85, 0x67, 0x39, 0xBA, 0xE4, 0x06, 0x58,
+	0x19, 0x47, 0xA5, 0xFB, 0x78, 0x26, 0xC4, 0x9A,
+	0x65, 0x3B, 0xD9, 0x87, 0x04, 0x5A, 0xB8, 0xE6,
+	0xA7, 0xF9, 0x1B, 0x45, 0xC6, 0x98, 0x7A, 0x24,
+	0xF8, 0xA6, 0x44, 0x1A, 0x99, 0xC7, 0x25, 0x7B,
+	0x3A, 0x64, 0x86, 0xD8, 0x5B, 0x05, 0xE7, 0xB9,
+	0x8C, 0xD2, 0x30, 0x6E, 0xED, 0xB3, 0x51, 0x0F,
+	0x4E, 0x10, 0xF2, 0xAC, 0x2F, 0x71, 0x93, 0xCD,
+	0x11, 0x4F, 0xAD, 0xF3, 0x70, 0x2E, 0xCC, 0x92,
+	0xD3, 0x8D, 0x6F, 0x31, 0xB2, 0xEC, 0x0E, 0x50,
+	0xAF, 0xF1, 0x13, 0x4D, 0xCE, 0x90, 0x72, 0x2C,
+	0x6D, 0x33, 0xD1, 0x8F, 0x0C, 0x52, 0xB0, 0xEE,
+	0x32, 0x6C, 0x8E, 0xD0, 0x53, 0x0D, 0xEF, 0xB1,
+	0xF0, 0xAE, 0x4C, 0x12, 0x91, 0xCF, 0x2D, 0x73,
+	0xCA, 0x94, 0x76, 0x28, 0xAB, 0xF5, 0x17, 0x49,
+	0x08, 0x56, 0xB4, 0xEA, 0x69, 0x37, 0xD5, 0x8B,
+	0x57, 0x09, 0xEB, 0xB5, 0x36, 0x68, 0x8A, 0xD4,
+	0x95, 0xCB, 0x29, 0x77, 0xF4, 0xAA, 0x48, 0x16,
+	0xE9, 0xB7, 0x55, 0x0B, 0x88, 0xD6, 0x34, 0x6A,
+	0x2B, 0x75, 0x97, 0xC9, 0x4A, 0x14, 0xF6, 0xA8,
+	0x74, 0x2A, 0xC8, 0x96, 0x15, 0x4B, 0xA9, 0xF7,
+	0xB6, 0xE8, 0x0A, 0x54, 0xD7, 0x89, 0x6B, 0x35
+};
+
+static uint8_t owi_crc(uint8_t databyte, uint8_t crc)
+{
+	return pgm_read_byte(&_owi_crc_table[crc ^ databyte]);
+}
+
+#elif OWI_CRC_TABLE == 16
+/*
+ *     The effect of shifting 4 bits out of the CRC, for each value of the 4 bits.
+ *     Each byte is processed as two nibbles, lsb first.
+ */
+static const uint8_t _owi_crc_table[16] PROGMEM =
+{
+	0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+	0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74
+};
+
+static uint8_t owi_crc(uint8_t databyte, uint8_t crc)
+{
+	crc ^= databyte;
+	crc = (crc >> 4) ^ pgm_read_byte(&_owi_crc_table[crc & 0x0F]);
+	crc = (crc >> 4) ^ pgm_read_byte(&_owi_crc_table[crc & 0x0F]);
+	return crc;
+}
+
+#else
 /*
  *     This function is based on the crc generation outlined in the
  *     DS18B20 datasheet pp. 8-9. 
@@ -159,18 +323,46 @@ static uint8_t owi_crc(uint8_t databyte, uint8_t crc)
 	}
 	return crc;
 }
+#endif
 
 
 
+uint8_t owi_crc8(const uint8_t *data, uint8_t length)
+{
+	uint8_t crc = 0x00;
+	
+	while (length--) crc = owi_crc(*data++, crc);
+	return crc;
+}
+
+
+
+#ifndef OWI_UART
+/*
+ *     The functions that time the slots take the bus as a constant, and are inlined 
+ *     once for each bus in OWI_BUSES by the functions that dispatch on the selected 
+ *     bus. The switches on the bus below then reduce to the case of that one bus, so 
+ *     the pin is fixed at compile time and each access is a single sbi, cbi or sbis 
+ *     instruction, as with one bus on a fixed pin. The dispatch happens before a slot 
+ *     starts, so it doesn't change the timing.
+ */
+#define OWI_INLINE		static inline __attribute__((always_inline))
+
+#define OWI_RELEASE_CASE(n, port, ddr, pin, mask)	case n: ddr &= (uint8_t)~(mask); port |= (mask); break;
+#define OWI_PULL_CASE(n, port, ddr, pin, mask)		case n: ddr |= (mask); port &= (uint8_t)~(mask); break;
+#define OWI_HIGH_CASE(n, port, ddr, pin, mask)		case n: return (pin & (mask)) != 0;
+
 /*
  *     Set the line high by enabling the internal pull-up resistor.
  *     The internal pull-up is enabled when the port bit is set 
  *     and the data direction is cleared.
  */
-static void release_line(void)
+OWI_INLINE void release_line(const uint8_t bus)
 {
-	OWI_DDR  &= OWI_IPINMASK;			//  clear the data direction 
-	OWI_PORT |= OWI_PINMASK;			//  set the port bit
+	switch (bus)
+	{
+		OWI_BUSES(OWI_RELEASE_CASE)			//  clear the data direction, set the port bit
+	}
 }
 
 
@@ -178,10 +370,87 @@ static void release_line(void)
 /*
  *     Pull the line low by disabling the internal pull-up resistors.
  */
-static void pull_line(void)
+OWI_INLINE void pull_line(const uint8_t bus)
 {
-	OWI_DDR  |= OWI_PINMASK;			//  set the data direction
-	OWI_PORT &= OWI_IPINMASK;			//  clear the port bit		
+	switch (bus)
+	{
+		OWI_BUSES(OWI_PULL_CASE)			//  set the data direction, clear the port bit
+	}
+}
+
+
+
+/*
+ *     Sample the line, returns 1 if it is high.
+ */
+OWI_INLINE int line_is_high(const uint8_t bus)
+{
+	switch (bus)
+	{
+		OWI_BUSES(OWI_HIGH_CASE)
+	}
+	return 1;
+}
+
+
+
+/*
+ *     At overdrive speed the time slots are about 10us, and the timing is
+ *     so tight that interrupts are disabled during the critical part.
+ *     The timings are the recommended values from Maxim application note 126.
+ */
+OWI_INLINE void owi_od_write_1(const uint8_t bus)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pull_line(bus);
+		_delay_us(1);
+		release_line(bus);
+	}
+	_delay_us(7.5);
+}
+
+OWI_INLINE void owi_od_write_0(const uint8_t bus)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pull_line(bus);
+		_delay_us(7.5);
+		release_line(bus);
+	}
+	_delay_us(2.5);
+}
+
+OWI_INLINE int owi_od_read_bit(const uint8_t bus)
+{
+	int bit = 0;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		pull_line(bus);
+		_delay_us(1);
+		release_line(bus);
+		_delay_us(1);						//  sample 2us after the line was pulled low
+		if (line_is_high(bus)) bit = 1;
+	}
+	_delay_us(7);
+	return bit;
+}
+
+OWI_INLINE int owi_od_detect_presence(const uint8_t bus)
+{
+	int presence = 1;
+	
+	pull_line(bus);							//  70us reset pulse
+	_delay_us(70);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		release_line(bus);
+		_delay_us(8.5);
+		if (line_is_high(bus)) presence = 0;
+	}
+	_delay_us(40);
+	return presence;
 }
 
 
@@ -191,11 +460,17 @@ static void pull_line(void)
  *     This is done by pulling the line down for 1 - 15us and then 
  *     releasing it for the rest of the 65us bit period.
  */
-static void owi_write_1(void)
+OWI_INLINE void owi_write_1_on(const uint8_t bus)
 {	
-	pull_line();
+	if (_owi_speed == OWI_OVERDRIVE)
+	{
+		owi_od_write_1(bus);
+		return;
+	}
+	
+	pull_line(bus);
 	_delay_us(1);
-	release_line();
+	release_line(bus);
 	_delay_us(64);					//  leave line hight for the rest of the 65us bit period
 }
 
@@ -206,11 +481,17 @@ static void owi_write_1(void)
  *     This is done by pulling the line down for 60 - 120us and then
  *     releasing it.
  */
-static void owi_write_0(void)
+OWI_INLINE void owi_write_0_on(const uint8_t bus)
 {	
-	pull_line();
+	if (_owi_speed == OWI_OVERDRIVE)
+	{
+		owi_od_write_0(bus);
+		return;
+	}
+	
+	pull_line(bus);
 	_delay_us(60);
-	release_line();
+	release_line(bus);
 	_delay_us(5);					//  leave line for at least 5us
 }
 
@@ -223,16 +504,18 @@ static void owi_write_0(void)
  *     level is checked. If the line is high, 1 is read, and if the line 
  *     is low, a 0 is read. 
  */
-static int owi_read_bit(void)
+OWI_INLINE int owi_read_bit_on(const uint8_t bus)
 {
 	int bit = 0;
 	
-	pull_line();			
+	if (_owi_speed == OWI_OVERDRIVE) return owi_od_read_bit(bus);
+	
+	pull_line(bus);			
 	_delay_us(1);
-	release_line();
+	release_line(bus);
 	_delay_us(14);					//  the line should be sampled 15us after the line was pulled low
 		
-	if (OWI_PIN & OWI_PINMASK) bit = 1;
+	if (line_is_high(bus)) bit = 1;
 	
 	_delay_us(45);
 	return bit;
@@ -244,19 +527,20 @@ static int owi_read_bit(void)
  *     Send a reset signal and listen for presence signal. Returns true for 
  *     presence or false for no presence.
  */
-int owi_detect_presence(void)
+OWI_INLINE int owi_reset_pulse_on(const uint8_t bus)
 {
 	int presence = 1;
 		
+	if (_owi_speed == OWI_OVERDRIVE) return owi_od_detect_presence(bus);
 		
 		//  Start transaction by holding the line down for 
 		//  480 - 560us. This is the RESET PULSE		 
-	pull_line();							//  Pull line down for 480us.
+	pull_line(bus);							//  Pull line down for 480us.
 	_delay_us(480);
-	release_line();								
+	release_line(bus);								
 	_delay_us(60);							//  Wait for 60us to sample the line.
 		
-	if (OWI_PIN & OWI_PINMASK) presence = 0;			//  Is line level is high? If so, no presence detected.
+	if (line_is_high(bus)) presence = 0;				//  Is line level is high? If so, no presence detected.
 	_delay_us(420);
 	
 	return presence;
@@ -264,6 +548,158 @@ int owi_detect_presence(void)
 
 
 
+/*
+ *     Each of these runs a slot on the selected bus, with the code inlined for that bus.
+ */
+#define OWI_WRITE_1_CASE(n, port, ddr, pin, mask)	case n: owi_write_1_on(n); break;
+#define OWI_WRITE_0_CASE(n, port, ddr, pin, mask)	case n: owi_write_0_on(n); break;
+#define OWI_READ_BIT_CASE(n, port, ddr, pin, mask)	case n: return owi_read_bit_on(n);
+#define OWI_RESET_CASE(n, port, ddr, pin, mask)		case n: return owi_reset_pulse_on(n);
+
+static void owi_write_1(void)
+{
+	switch (OWI_SELECTED_BUS)
+	{
+		OWI_BUSES(OWI_WRITE_1_CASE)
+	}
+}
+
+static void owi_write_0(void)
+{
+	switch (OWI_SELECTED_BUS)
+	{
+		OWI_BUSES(OWI_WRITE_0_CASE)
+	}
+}
+
+static int owi_read_bit(void)
+{
+	switch (OWI_SELECTED_BUS)
+	{
+		OWI_BUSES(OWI_READ_BIT_CASE)
+	}
+	return 1;
+}
+
+static int owi_reset_pulse(void)
+{
+	switch (OWI_SELECTED_BUS)
+	{
+		OWI_BUSES(OWI_RESET_CASE)
+	}
+	return 0;
+}
+
+#else
+
+/*
+ *     Set up USART0 for 8 data bits, no parity and 1 stop bit in double
+ *     speed mode, with both transmitter and receiver enabled.
+ */
+static void owi_uart_init(void)
+{
+	UCSR0A = (1 << U2X0);
+	UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+	UCSR0C = (1 << UCSZ01) | (1 << UCSZ00);
+}
+
+
+
+/*
+ *     Set the baud rate for bit slots at the current speed.
+ */
+static void owi_uart_bit_rate(void)
+{
+	UBRR0 = (_owi_speed == OWI_OVERDRIVE) ? OWI_UBRR_OD_BIT : OWI_UBRR_BIT;
+}
+
+
+
+/*
+ *     Transmit one byte and return the echo from the line.
+ */
+static uint8_t owi_uart_exchange(uint8_t data)
+{
+	while (UCSR0A & (1 << RXC0)) (void)UDR0;			//  discard anything old
+	UDR0 = data;
+	while (!(UCSR0A & (1 << RXC0))) HAL_POLL();
+	return UDR0;
+}
+
+
+
+/*
+ *     Write a high bit. The start bit is the 1 - 15us low pulse.
+ */
+static void owi_write_1(void)
+{
+	owi_uart_exchange(0xFF);
+}
+
+
+
+/*
+ *     Write a low bit. The start bit and 8 low data bits hold the line 
+ *     low for about 78us.
+ */
+static void owi_write_0(void)
+{
+	owi_uart_exchange(0x00);
+}
+
+
+
+/*
+ *     Read bit, returns 1 or 0. The slave holds the line low for a 0, 
+ *     which changes the echo.
+ */
+static int owi_read_bit(void)
+{
+	return owi_uart_exchange(0xFF) == 0xFF;
+}
+
+
+
+/*
+ *     Send a reset signal and listen for presence signal. At 9600 baud, 
+ *     the start bit and four low bits of 0xF0 is a 520us reset pulse. 
+ *     A presence pulse changes the echo.
+ */
+static int owi_reset_pulse(void)
+{
+	uint8_t echo;
+	
+	owi_uart_init();
+	if (_owi_speed == OWI_OVERDRIVE)
+	{
+		UBRR0 = OWI_UBRR_OD_RESET;				//  start bit and five low bits, 52us
+		echo  = owi_uart_exchange(0xE0);
+		owi_uart_bit_rate();
+		return echo != 0xE0;
+	}
+	
+	UBRR0 = OWI_UBRR_RESET;
+	echo  = owi_uart_exchange(0xF0);
+	owi_uart_bit_rate();
+	
+	return echo != 0xF0;
+}
+#endif
+
+
+
+int owi_detect_presence(void)
+{
+	PROF_START(t);
+	int presence = owi_reset_pulse();
+	PROF_STOP(PROF_OWI, t);
+	
+	if (!presence) PROF_ERROR(PROF_OWI);
+	return presence;
+}
+
+
+
 /*
  *     Send one byte of data on the one wire bus, lsb first. Notice that in the 
  *     for loop, mask is an 8 bit integer, initiated as binary 0000 0001, and 
@@ -326,10 +762,136 @@ int owi_is_busy(void)
 
 
 /*
- *     NOT IMPLEMENTED:
- *     Send a SEARCH ROM command on the one wire bus
+ *     One search cycle, shared by the search ROM and alarm search commands.
+ *     For each of the 64 bits of the ROM code, all participating slaves place
+ *     the bit on the bus, then its complement. Because the bus is wired-and,
+ *     the master reads:
+ *     - 0b01 or 0b10: all slaves have the same bit, which is the first bit read.
+ *     - 0b00:         there is a discrepancy, slaves have both 0 and 1.
+ *     - 0b11:         no slaves are participating.
+ *     The master then writes the bit it chose, and the slaves with a different
+ *     bit drop out until the next reset.
+ *     At a discrepancy, the master takes the 0 branch at positions beyond where it
+ *     took the 0 branch last time, follows the previous ROM code at lower positions
+ *     and takes the 1 branch at that position. The last position where it took the 0
+ *     branch is where the next search must turn. When there is no such position, all
+ *     devices have been found.
+ *
+ *     \param *state    The state of the search.
+ *     \param command   OWI_SEARCH_ROM or OWI_ALARM_SEARCH.
+ *     \return          1 if a device was found and state->rom holds a valid ROM code, 0 if not.
+ *
+ *     Note:            On failure the search is ended, so the next search will fail
+ *                      until a new search is started.
+ */
+static int owi_search(struct owi_search_state *state, uint8_t command)
+{
+	uint8_t last_zero = 0;
+	
+	if (state->done) return 0;
+	state->done = 1;						//  until proven otherwise
+	
+	if (!owi_detect_presence()) return 0;
+	owi_write_byte(command);
+	
+	for (uint8_t position = 1; position <= 64; position++)
+	{
+		uint8_t *byte = &state->rom[(position - 1) >> 3];
+		uint8_t  mask = 0x01 << ((position - 1) & 0x07);
+		uint8_t  bit  = owi_read_bit();
+		uint8_t  cmp  = owi_read_bit();
+		
+		if (bit && cmp) return 0;				//  no slaves are participating
+		if (bit == cmp)						//  discrepancy, choose a branch
+		{
+			if (position < state->last_discrepancy) bit = (*byte & mask) != 0;
+			else bit = (position == state->last_discrepancy);
+			if (!bit) last_zero = position;
+		}
+		
+		if (bit)
+		{
+			*byte |= mask;
+			owi_write_1();
+		}
+		else
+		{
+			*byte &= ~mask;
+			owi_write_0();
+		}
+	}
+	
+		//  confirm CRC. A shorted line reads all zeros, which has a valid CRC, so check the family code too.
+	if (owi_crc8(state->rom, 7) != state->rom[7] || state->rom[0] == 0x00) return 0;
+	
+	state->last_discrepancy = last_zero;
+	state->done = (last_zero == 0);
+	return 1;
+}
+
+
+
+/*
+ *     Reset the state of a search.
  */
-void owi_search_rom(void) {}
+static void owi_search_reset(struct owi_search_state *state)
+{
+	for (uint8_t i = 0; i < 8; i++) state->rom[i] = 0x00;
+	state->last_discrepancy = 0;
+	state->done = 0;
+}
+
+
+
+/*
+ *     Search for the next device and copy its ROM code.
+ *
+ *     \return     1 if a device was found, 0 if not.
+ */
+static int owi_search_copy(struct owi_search_state *state, uint8_t command, uint8_t *romcode_array)
+{
+	if (!owi_search(state, command)) return 0;
+	for (uint8_t i = 0; i < 8; i++) romcode_array[i] = state->rom[i];
+	return 1;
+}
+
+
+
+/*
+ *     Run a complete search and store the ROM codes in table.
+ *
+ *     \return     Number of ROM codes found, at most capacity.
+ */
+static int owi_search_table(struct owi_search_state *state, uint8_t command, uint8_t (*table)[8], int capacity)
+{
+	int count = 0;
+	
+	owi_search_reset(state);
+	while (count < capacity && owi_search_copy(state, command, table[count])) count++;
+	return count;
+}
+
+
+
+int owi_search_first(uint8_t *romcode_array)
+{
+	owi_search_reset(&_owi_search);
+	return owi_search_copy(&_owi_search, OWI_SEARCH_ROM, romcode_array);
+}
+
+
+
+int owi_search_next(uint8_t *romcode_array)
+{
+	return owi_search_copy(&_owi_search, OWI_SEARCH_ROM, romcode_array);
+}
+
+
+
+int owi_search_rom(uint8_t (*table)[8], int capacity)
+{
+	return owi_search_table(&_owi_search, OWI_SEARCH_ROM, table, capacity);
+}
 
 
 
@@ -368,8 +930,8 @@ int owi_read_rom(uint8_t *rom_array)
 	}
 	
 		//  Confirm CRC
-	for (int i = 0; i < 7; i++) crc = owi_crc(temp_array[i], crc);
-	if (crc != temp_array[7]) return crc;
+	crc = owi_crc8(temp_array, 7);
+	if (crc != temp_array[7]) return 0;
 	
 		//  If CRC is confirmed, copy temp_array into rom_array parameter.
 	for (int i = 0; i < 8; i++) rom_array[i] = temp_array[i];
@@ -435,18 +997,389 @@ int owi_alarm_search(void)
 	
 		/*
 		 *     Interpret the response.
-		 *     XOR truth table:
-		 *     0 XOR 0 = 0      Will never happen with only one device on the bus.
-		 *     0 XOR 1 = 1      Meaning device responded.
-		 *     1 XOR 0 = 1                 "
-		 *     1 XOR 1 = 0      Meaning no response.
+		 *     0b00      Devices with different first bits responded.
+		 *     0b01      Device(s) responded.
+		 *     0b10                 "
+		 *     0b11      Meaning no response.
 		 *     The ROM code of all DS18B20 ends with 0x28 = 0b0010 1000 so the 
-		 *     response will be either 01 or 11.
+		 *     response from DS18B20 devices alone will be either 01 or 11.
 		 */
-	if (!(first ^ second)) return 0;     //  no response, no alarm
+	if (first && second) return 0;     //  no response, no alarm
 	
 		//  Write the first bit on the bus to keep the device selected.
 	if (first) owi_write_1();
 	else       owi_write_0();
 	return 1;
 }
+
+
+
+void owi_set_speed(uint8_t speed)
+{
+	_owi_speed = speed;
+#ifdef OWI_UART
+	owi_uart_bit_rate();
+#endif
+}
+
+
+
+uint8_t owi_get_speed(void)
+{
+	return _owi_speed;
+}
+
+
+
+int owi_overdrive_capable(const uint8_t *romcode_array)
+{
+	for (uint8_t i = 0; i < sizeof(_owi_overdrive_families); i++)
+	{
+		if (romcode_array[0] == _owi_overdrive_families[i]) return 1;
+	}
+	return 0;
+}
+
+
+
+void owi_overdrive_skip_rom(void)
+{
+	owi_set_speed(OWI_STANDARD);
+	owi_write_byte(OWI_OVERDRIVE_SKIP_ROM);
+	owi_set_speed(OWI_OVERDRIVE);
+}
+
+
+
+void owi_overdrive_match_rom(const uint8_t *romcode_array)
+{
+	owi_set_speed(OWI_STANDARD);
+	owi_write_byte(OWI_OVERDRIVE_MATCH_ROM);
+	owi_set_speed(OWI_OVERDRIVE);
+	for (int i = 0; i < 8; i++) owi_write_byte(romcode_array[i]);
+}
+
+
+
+/*
+ *     The reset pulse is always of standard length, which returns all devices
+ *     to standard speed. This keeps a bus with both kinds of devices in order.
+ */
+int owi_select(const uint8_t *romcode_array, uint8_t speed)
+{
+	owi_set_speed(OWI_STANDARD);
+	if (!owi_detect_presence()) return 0;
+	
+	if (speed == OWI_OVERDRIVE && owi_overdrive_capable(romcode_array)) owi_overdrive_match_rom(romcode_array);
+	else owi_match_rom((uint8_t *)romcode_array);
+	return 1;
+}
+
+
+
+#ifdef OWI_MULTI_BUS
+int owi_select_bus(uint8_t bus)
+{
+	if (bus >= OWI_BUS_COUNT) return 0;
+	_owi_bus = bus;
+	return 1;
+}
+
+
+
+uint8_t owi_get_bus(void)
+{
+	return _owi_bus;
+}
+#endif
+
+
+
+int owi_alarm_first(uint8_t *romcode_array)
+{
+	owi_search_reset(&_owi_alarm);
+	return owi_search_copy(&_owi_alarm, OWI_ALARM_SEARCH, romcode_array);
+}
+
+
+
+int owi_alarm_next(uint8_t *romcode_array)
+{
+	return owi_search_copy(&_owi_alarm, OWI_ALARM_SEARCH, romcode_array);
+}
+
+
+
+int owi_alarm_search_all(uint8_t (*table)[8], int capacity)
+{
+	return owi_search_table(&_owi_alarm, OWI_ALARM_SEARCH, table, capacity);
+}
+
+
+
+#ifdef OWI_ASYNC
+/*
+ *     Background transactions.
+ */
+enum {OWI_RESET, OWI_PRESENCE, OWI_RECOVERY, OWI_SLOT, OWI_RELEASE};
+
+static struct owi_transaction * volatile _owi_transaction = 0;
+static uint8_t _owi_state;
+static uint8_t _owi_index;						//  byte index, writes first, then reads
+static uint8_t _owi_mask;						//  bit within the byte, lsb first
+
+static void owi_stop(void);
+
+/*
+ *     Stop the interrupt and signal that the transaction is complete.
+ */
+static void owi_complete(uint8_t status)
+{
+	struct owi_transaction *t = _owi_transaction;
+	
+	owi_stop();
+	_owi_transaction = 0;
+	t->status = status;
+	if (t->callback) t->callback(t);
+}
+
+/*
+ *     Move on to the next bit.
+ */
+static void owi_advance(void)
+{
+	_owi_mask <<= 1;
+	if (!_owi_mask)
+	{
+		_owi_mask = 0x01;
+		_owi_index++;
+	}
+}
+
+#ifndef OWI_UART
+/*
+ *     Timer2 runs in CTC mode with a prescaler of 32, that is 2us per tick at 16MHz.
+ *     Each interrupt does the short part of a time slot, pulling the line low for 1us
+ *     or sampling the line, then sets the compare register to the time until the next
+ *     thing that has to happen and returns. A 480us reset pulse and a 60us low bit are
+ *     mostly waiting, so this frees the CPU for most of the transaction.
+ */
+#define OWI_TICKS(us)		((us) * (F_CPU / 1000000ul) / 32)
+#define OWI_TIMER_START		0x03					//  TCCR2B: clk/32
+
+/*
+ *     Set the time until the next interrupt.
+ */
+static void owi_schedule(uint8_t ticks, uint8_t state)
+{
+	_owi_state = state;
+	TCNT2 = 0;
+	OCR2A = ticks - 1;
+}
+
+/*
+ *     Stop the timer.
+ */
+static void owi_stop(void)
+{
+	TIMSK2 &= ~(1 << OCIE2A);
+	TCCR2B  = 0x00;
+}
+
+/*
+ *     A transaction stays on the bus it was submitted on, even if another bus is 
+ *     selected while it runs.
+ */
+#ifdef OWI_MULTI_BUS
+static uint8_t _owi_async_bus;
+#define OWI_ASYNC_BUS		_owi_async_bus
+#else
+#define OWI_ASYNC_BUS		0
+#endif
+
+/*
+ *     Start the next time slot, or complete the transaction if all bytes
+ *     have been written and read.
+ */
+OWI_INLINE void owi_next_slot(struct owi_transaction *t, const uint8_t bus)
+{
+	if (_owi_index < t->n_write)
+	{
+		pull_line(bus);
+		if (t->write[_owi_index] & _owi_mask)
+		{
+			_delay_us(1);
+			release_line(bus);
+			owi_schedule(OWI_TICKS(64), OWI_SLOT);			//  rest of the 65us bit period
+		}
+		else owi_schedule(OWI_TICKS(60), OWI_RELEASE);
+	}
+	else if (_owi_index < t->n_write + t->n_read)
+	{
+		uint8_t *data = &t->read[_owi_index - t->n_write];
+		
+		pull_line(bus);
+		_delay_us(1);
+		release_line(bus);
+		_delay_us(12);						//  sample close to 15us after the line was pulled low
+		if (line_is_high(bus)) *data |= _owi_mask;
+		else *data &= ~_owi_mask;
+		owi_schedule(OWI_TICKS(48), OWI_SLOT);
+	}
+	else
+	{
+		owi_complete(OWI_DONE);
+		return;
+	}
+	
+	owi_advance();
+}
+
+OWI_INLINE void owi_interrupt(struct owi_transaction *t, const uint8_t bus)
+{
+	switch (_owi_state)
+	{
+		case OWI_RESET:							//  end of the reset pulse
+			release_line(bus);
+			owi_schedule(OWI_TICKS(70), OWI_PRESENCE);
+			break;
+		case OWI_PRESENCE:						//  sample the presence pulse
+			t->presence = !line_is_high(bus);
+			owi_schedule(OWI_TICKS(410), OWI_RECOVERY);
+			break;
+		case OWI_RECOVERY:						//  end of the presence period
+			if (!t->presence) owi_complete(OWI_ERROR);
+			else owi_next_slot(t, bus);
+			break;
+		case OWI_RELEASE:						//  end of a low bit
+			release_line(bus);
+			owi_schedule(OWI_TICKS(6), OWI_SLOT);
+			break;
+		default:
+			owi_next_slot(t, bus);
+			break;
+	}
+}
+
+#define OWI_INTERRUPT_CASE(n, port, ddr, pin, mask)	case n: owi_interrupt(t, n); break;
+
+ISR(TIMER2_COMPA_vect)
+{
+	struct owi_transaction *t = _owi_transaction;
+	
+	switch (OWI_ASYNC_BUS)
+	{
+		OWI_BUSES(OWI_INTERRUPT_CASE)
+	}
+}
+
+
+
+/*
+ *     Start the reset pulse on the selected bus, the interrupt takes it from here.
+ */
+#define OWI_START_CASE(n, port, ddr, pin, mask)		case n: pull_line(n); break;
+
+static void owi_start(void)
+{
+#ifdef OWI_MULTI_BUS
+	_owi_async_bus = _owi_bus;
+#endif
+	switch (OWI_ASYNC_BUS)
+	{
+		OWI_BUSES(OWI_START_CASE)
+	}
+	TCCR2A  = (1 << WGM21);						//  CTC mode
+	owi_schedule(OWI_TICKS(480), OWI_RESET);
+	TIFR2   = (1 << OCF2A);						//  clear any old compare match
+	TIMSK2 |= (1 << OCIE2A);
+	TCCR2B  = OWI_TIMER_START;
+}
+
+#else
+
+/*
+ *     With OWI_UART, the USART does all the timing. The receive complete 
+ *     interrupt handles the echo of one slot and transmits the next.
+ */
+static void owi_stop(void)
+{
+	UCSR0B &= ~(1 << RXCIE0);
+}
+
+/*
+ *     Transmit the next time slot, or complete the transaction if all bytes
+ *     have been written and read.
+ */
+static void owi_next_slot(struct owi_transaction *t)
+{
+	if (_owi_index < t->n_write) UDR0 = (t->write[_owi_index] & _owi_mask) ? 0xFF : 0x00;
+	else if (_owi_index < t->n_write + t->n_read) UDR0 = 0xFF;
+	else owi_complete(OWI_DONE);
+}
+
+ISR(USART_RX_vect)
+{
+	struct owi_transaction *t = _owi_transaction;
+	uint8_t echo = UDR0;
+	
+	if (_owi_state == OWI_RESET)					//  echo of the reset pulse
+	{
+		t->presence = (echo != 0xF0);
+		if (!t->presence)
+		{
+			owi_complete(OWI_ERROR);
+			return;
+		}
+		UBRR0 = OWI_UBRR_BIT;
+		_owi_state = OWI_SLOT;
+	}
+	else
+	{
+		if (_owi_index >= t->n_write)				//  echo of a read slot
+		{
+			uint8_t *data = &t->read[_owi_index - t->n_write];
+			if (echo == 0xFF) *data |= _owi_mask;
+			else *data &= ~_owi_mask;
+		}
+		owi_advance();
+	}
+	owi_next_slot(t);
+}
+
+/*
+ *     Transmit the reset pulse, the interrupt takes it from here.
+ */
+static void owi_start(void)
+{
+	owi_uart_init();
+	UBRR0 = OWI_UBRR_RESET;
+	_owi_state = OWI_RESET;
+	UCSR0B |= (1 << RXCIE0);
+	UDR0 = 0xF0;
+}
+#endif
+
+
+
+int owi_submit(struct owi_transaction *t)
+{
+	if (_owi_transaction) return 0;
+	
+	t->status   = OWI_PENDING;
+	t->presence = 0;
+	_owi_index  = 0;
+	_owi_mask   = 0x01;
+	_owi_transaction = t;
+	
+	owi_start();
+	return 1;
+}
+
+
+
+int owi_async_busy(void)
+{
+	return _owi_transaction != 0;
+}
+#endif
@@ -9,18 +9,36 @@
  *	
  * Limitations:
  *
- *          This is an incomplete implementation of the protocol and does not support the 
- *          SEARCH ROM command.
+ *          This is an incomplete implementation of the protocol. There is one search ROM
+ *          in progress at a time, so owi_search_rom and owi_search_first/owi_search_next
+ *          should not be mixed. The same goes for the alarm search functions.
  *	
- *          The ALARM SEARCH command is only partially implemented, meaning that it targets 
- *          DS18B20 devices. It can, in theory, be used with other alarm devices but this 
- *          has not been tested.
+ *          The ALARM SEARCH command targets DS18B20 devices. It can, in theory, be used
+ *          with other alarm devices but this has not been tested.
  *
  * Dependencies:
  *
  *          util/delay.h: The delay function is used to control the amount of time the line is held high
  *                        or low in accordance with the Onewire protocol.
  *          avr/io.h:     This library relies on some port definitions in avr/io.h.
+ *          avr/interrupt.h:
+ *                        If OWI_ASYNC is defined, Timer2 and its compare match interrupt are
+ *                        used to time the bits of background transactions.
+ *
+ * Multiple buses:
+ *
+ *          If OWI_MULTI_BUS is defined in the project's symbols, the buses are listed in
+ *          OWI_BUSES, and owi_select_bus chooses the bus that the functions below work on.
+ *          The pins are fixed at compile time. Each bus gets its own copy of the code that
+ *          times the slots, so each bus is as fast as the single bus on PB0, at the cost
+ *          of some flash for each bus.
+ *
+ * Backends:
+ *
+ *          By default, the bus is on PB0 and the time slots are timed in software. If
+ *          OWI_UART is defined in the project's symbols, USART0 generates the time slots
+ *          instead, with TXD and RXD joined to the bus through an open drain driver, f.ex
+ *          a schottky diode with its cathode on TXD, and RXD on the bus. The API is the same.
  *
  * License:
  *
@@ -55,6 +73,50 @@ extern "C" {
 
 
 
+#ifdef OWI_MULTI_BUS
+/*
+ *     The buses, as a list of X(number, port, ddr, pin, mask). The buses are numbered
+ *     0, 1, 2 and so on, in the order of the list, and bus 0 is selected at start. The 
+ *     default is three buses on PB0, PB1 and PB2. Define OWI_BUSES in the project's 
+ *     symbols to use other pins.
+ *
+ *     Example:  a bus on PB0 and a second bus on PD4
+ *     OWI_BUSES(X)=X(0, PORTB, DDRB, PINB, 0x01) X(1, PORTD, DDRD, PIND, 0x10)
+ *
+ *     note:  The mask must be a constant, with one bit set.
+ */
+#ifndef OWI_BUSES
+#define OWI_BUSES(X)  X(0, PORTB, DDRB, PINB, 0x01) X(1, PORTB, DDRB, PINB, 0x02) X(2, PORTB, DDRB, PINB, 0x04)
+#endif
+
+#define OWI_COUNT_BUS(n, port, ddr, pin, mask)  + 1
+#define OWI_BUS_COUNT  (0 OWI_BUSES(OWI_COUNT_BUS))
+
+/*
+ *     Select the bus used by all the functions below.
+ *
+ *     \param bus     Number of the bus in OWI_BUSES.
+ *     \return        1 if successful, 0 if there is no such bus.
+ *
+ *     note:  A search, with owi_search_first/owi_search_next, works on the bus that
+ *            is selected when each function is called. Don't select another bus until 
+ *            it's complete. A background transaction stays on the bus it started on.
+ */
+int owi_select_bus(uint8_t bus);
+
+/*
+ *     Get the selected bus.
+ *
+ *     \return        Number of the bus in OWI_BUSES.
+ */
+uint8_t owi_get_bus(void);
+
+#else
+#define OWI_BUS_COUNT  1
+#endif
+
+
+
 /*
  *     All transactions on the one wire bus begin with an initialization sequence.
  *     This sequence consists of a reset pulse transmitted by the bus master followed
@@ -82,6 +144,22 @@ void owi_write_byte(unsigned char data);
  */
 unsigned char owi_read_byte(void);
 
+/*
+ *     Calculate the 8-bit CRC of a string of bytes, as used by 1-wire devices.
+ *
+ *     \param *data     Pointer to the bytes.
+ *     \param length    Number of bytes.
+ *     \return          The CRC.
+ *
+ *     note:  The data is valid if the CRC of the bytes, not including the CRC 
+ *            byte, equals the CRC byte. Equivalently, the CRC of the bytes 
+ *            including the CRC byte is 0.
+ *
+ *     note:  Define OWI_CRC_TABLE as 256, 16 or 0 to choose between a 256 byte
+ *            table, a 16 byte table or no table. The default is 16.
+ */
+uint8_t owi_crc8(const uint8_t *data, uint8_t length);
+
 /*
  *     Check if one wire device is busy.
  *
@@ -90,13 +168,47 @@ unsigned char owi_read_byte(void);
 int owi_is_busy(void);
 
 /*
- *     NOT IMPLEMENTED!
- *     After the bus master has detected a presence pulse, it can issue a ROM
- *     command. These commands operate on the unique 64-bit ROM codes of each
- *     slave device and allow the master to single out a specific device if 
- *     many are present on the bus. There are five ROM commands.
+ *     Find the ROM codes of all devices on the bus and store them in a table.
+ *
+ *     \param table      Array of 8 byte ROM codes that will receive the ROM codes.
+ *     \param capacity   Number of ROM codes the table can hold.
+ *     \return           Number of ROM codes found, at most capacity.
+ *
+ *     Example:  uint8_t roms[20][8];
+ *               int n = owi_search_rom(roms, 20);
+ *
+ *     note:  Each ROM code takes one search cycle of about 13ms, so searching a bus
+ *            with many devices takes a while. Use owi_search_first and owi_search_next
+ *            to spread the search over several iterations of the main loop.
+ *
+ *     note:  Only ROM codes with a valid CRC are stored. If a search cycle fails,
+ *            the search stops and the ROM codes found so far are kept.
  */
-void owi_search_rom(void);
+int owi_search_rom(uint8_t (*table)[8], int capacity);
+
+/*
+ *     Start a new search and find the first device on the bus.
+ *
+ *     \param *romcode_array   Pointer to an 8 byte array of uint8_t that will
+ *                             receive the ROM code.
+ *     \return                 1 if a device was found, 0 if not.
+ */
+int owi_search_first(uint8_t *romcode_array);
+
+/*
+ *     Find the next device on the bus. Call owi_search_first first.
+ *
+ *     \param *romcode_array   Pointer to an 8 byte array of uint8_t that will
+ *                             receive the ROM code.
+ *     \return                 1 if a device was found, 0 if the search is complete
+ *                             or failed.
+ *
+ *     Example:  uint8_t rom[8];
+ *               for (int found = owi_search_first(rom); found; found = owi_search_next(rom)) ...
+ *
+ *     note:   The ROM codes are found in order of increasing value, read lsb first.
+ */
+int owi_search_next(uint8_t *romcode_array);
 
 
 /*
@@ -139,13 +251,175 @@ void owi_match_rom(uint8_t *romcode_array);
  */
 void owi_skip_rom(void);
 
+/*
+ *     Bus speeds.
+ */
+#define OWI_STANDARD  0
+#define OWI_OVERDRIVE 1
+
+/*
+ *     Set the speed of the time slots and reset pulses that follow. This does
+ *     not change the speed of the devices, use the overdrive ROM commands below.
+ *
+ *     \param speed   OWI_STANDARD or OWI_OVERDRIVE
+ *
+ *     note:  Overdrive timing is tight, so interrupts are disabled during the 
+ *            critical part of each time slot.
+ */
+void owi_set_speed(uint8_t speed);
+
+/*
+ *     Get the current speed.
+ *
+ *     \return        OWI_STANDARD or OWI_OVERDRIVE
+ */
+uint8_t owi_get_speed(void);
+
+/*
+ *     Check if a device supports overdrive speed. This is decided by the family
+ *     code, f.ex the DS18B20 does not. 
+ *
+ *     \param *romcode_array    Pointer to an 8 byte ROM code.
+ *     \return                  1 if the device supports overdrive, 0 if not or unknown.
+ */
+int owi_overdrive_capable(const uint8_t *romcode_array);
+
+/*
+ *     Put all overdrive capable devices in overdrive mode and switch the bus to
+ *     overdrive speed. Call this after owi_detect_presence at standard speed.
+ */
+void owi_overdrive_skip_rom(void);
+
+/*
+ *     Put one device in overdrive mode, and address it. The command is sent at
+ *     standard speed and the ROM code at overdrive speed. Call this after 
+ *     owi_detect_presence at standard speed.
+ *
+ *     \param *romcode_array    Pointer to an 8 byte ROM code.
+ */
+void owi_overdrive_match_rom(const uint8_t *romcode_array);
+
+/*
+ *     Reset the bus and address a device at the speed given, or at standard speed
+ *     if the device doesn't support overdrive. Use this with a speed flag for each
+ *     device to run a bus with both kinds of devices.
+ *
+ *     \param *romcode_array    Pointer to an 8 byte ROM code.
+ *     \param speed             OWI_STANDARD or OWI_OVERDRIVE
+ *     \return                  1 for presence, 0 for no presence
+ *
+ *     Example:  if (owi_select(rom, OWI_OVERDRIVE)) owi_write_byte(...);
+ *
+ *     note:   Use owi_get_speed to find out which speed was used.
+ */
+int owi_select(const uint8_t *romcode_array, uint8_t speed);
+
 /*
  *     Check if any device on the bus has an alarm flag set.
  *
  *     \return: 1 if alarm, 0 if no alarm
+ *
+ *     note:   This only takes one bit of the alarm search, use the functions
+ *             below to find out which devices have the alarm flag set.
  */
 int owi_alarm_search(void);
 
+/*
+ *     Find the ROM codes of all devices on the bus that have the alarm flag set,
+ *     and store them in a table.
+ *
+ *     \param table      Array of 8 byte ROM codes that will receive the ROM codes.
+ *     \param capacity   Number of ROM codes the table can hold.
+ *     \return           Number of ROM codes found, at most capacity.
+ *
+ *     note:  This works like owi_search_rom, except that only devices with the
+ *            alarm flag set take part. After a temperature conversion, only these
+ *            devices need to be read.
+ */
+int owi_alarm_search_all(uint8_t (*table)[8], int capacity);
+
+/*
+ *     Start a new alarm search and find the first device with the alarm flag set.
+ *
+ *     \param *romcode_array   Pointer to an 8 byte array of uint8_t that will
+ *                             receive the ROM code.
+ *     \return                 1 if a device was found, 0 if not.
+ */
+int owi_alarm_first(uint8_t *romcode_array);
+
+/*
+ *     Find the next device with the alarm flag set. Call owi_alarm_first first.
+ *
+ *     \param *romcode_array   Pointer to an 8 byte array of uint8_t that will
+ *                             receive the ROM code.
+ *     \return                 1 if a device was found, 0 if the search is complete
+ *                             or failed.
+ */
+int owi_alarm_next(uint8_t *romcode_array);
+
+
+
+#ifdef OWI_ASYNC
+/*
+ *     Background transactions.
+ *
+ *     Define OWI_ASYNC in the project's symbols to run transactions in the background.
+ *     The bits are timed by Timer2 and its compare match interrupt, so the CPU is free
+ *     for other work during most of each time slot. Timer2 can not be used for anything
+ *     else. With OWI_UART, the USART receive complete interrupt is used instead, and
+ *     Timer2 is free.
+ *
+ *     A transaction is a reset pulse, followed by n_write bytes written and n_read bytes 
+ *     read. If the transaction has a callback, it is called from the interrupt when the
+ *     transaction is complete.
+ *
+ *     Example:   read the scratchpad of a single DS18B20.
+ *     static const uint8_t cmd[2] = {0xCC, 0xBE};
+ *     static uint8_t scratchpad[9];
+ *     static struct owi_transaction t = {cmd, 2, scratchpad, 9, OWI_IDLE, 0, 0};
+ *     owi_submit(&t);
+ *     ...
+ *     if (t.status == OWI_DONE) ...
+ *
+ *     Note:  Don't use the blocking functions while a transaction is pending.
+ *
+ *     Note:  Interrupts must be enabled, see sei() in avr/interrupt.h.
+ *
+ *     Note:  Background transactions always run at standard speed.
+ */
+#define OWI_IDLE      0						//  status values
+#define OWI_PENDING   1
+#define OWI_DONE      2
+#define OWI_ERROR     3						//  no presence pulse
+
+struct owi_transaction
+{
+	const uint8_t    *write;					//  bytes to write after the reset pulse
+	uint8_t           n_write;
+	uint8_t          *read;						//  buffer for the bytes read
+	uint8_t           n_read;
+	volatile uint8_t  status;
+	uint8_t           presence;					//  1 if a presence pulse was detected
+	void            (*callback)(struct owi_transaction *);		//  called from the interrupt, may be 0
+};
+
+/*
+ *     Start a transaction in the background.
+ *
+ *     \param *t     Pointer to the transaction. It must not change until the status is
+ *                   OWI_DONE or OWI_ERROR.
+ *     \return       1 if the transaction was started, 0 if another transaction is pending.
+ */
+int owi_submit(struct owi_transaction *t);
+
+/*
+ *     Check if a background transaction is pending.
+ *
+ *     \return       1 for busy, 0 for not busy
+ */
+int owi_async_busy(void);
+#endif
+
 	
 #ifdef __cplusplus
 }
@@ -0,0 +1,166 @@
+/*
+ * prof.c
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To measure where the time goes in the drivers on real hardware.
+ *
+ * Dependencies:
+ *
+ *          prof.h
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "prof.h"
+
+#ifdef PROFILE
+
+#include "hal.h"
+
+
+static struct prof_counter _prof[PROF_COUNT];
+
+static const char _prof_names[PROF_COUNT][4] PROGMEM = {"TWI", "OWI", "LCD", "RTC", "TMP"};
+
+
+
+/*
+ *     Write an unsigned number without padding.
+ */
+static char *prof_number(char *p, uint32_t n)
+{
+	char    digits[10];
+	uint8_t len = 0;
+	
+	do
+	{
+		digits[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (len) *p++ = digits[--len];
+	*p = 0;
+	return p;
+}
+
+
+
+void prof_record(uint8_t id, uint32_t us)
+{
+	if (id >= PROF_COUNT) return;
+	if (us > 0xFFFF) us = 0xFFFF;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_prof[id].calls++;
+		_prof[id].total += us;
+		if (us > _prof[id].max) _prof[id].max = us;
+	}
+}
+
+
+
+void prof_error(uint8_t id)
+{
+	if (id >= PROF_COUNT) return;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (_prof[id].errors != 0xFFFF) _prof[id].errors++;
+	}
+}
+
+
+
+void prof_get(uint8_t id, struct prof_counter *counter)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*counter = _prof[id];
+	}
+}
+
+
+
+void prof_reset(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (uint8_t id = 0; id < PROF_COUNT; id++)
+		{
+			_prof[id].calls  = 0;
+			_prof[id].total  = 0;
+			_prof[id].max    = 0;
+			_prof[id].errors = 0;
+		}
+	}
+}
+
+
+
+char *prof_format(char *p, uint8_t id, uint8_t line)
+{
+	struct prof_counter c;
+	
+	prof_get(id, &c);
+	if (line == 0)
+	{
+		strcpy_P(p, _prof_names[id]);
+		p += 3;
+		*p++ = ' ';
+		*p++ = 'n';
+		p = prof_number(p, c.calls);
+		*p++ = ' ';
+		*p++ = 'e';
+		return prof_number(p, c.errors);
+	}
+	
+	*p++ = 'm'; *p++ = 'a'; *p++ = 'x';
+	p = prof_number(p, c.max);
+	*p++ = ' ';
+	*p++ = 'a'; *p++ = 'v'; *p++ = 'g';
+	p = prof_number(p, c.calls ? c.total / c.calls : 0);
+	*p++ = 'u';
+	*p++ = 's';
+	*p   = 0;
+	return p;
+}
+
+
+
+void prof_dump(void (*put)(const char *line))
+{
+	char line[24];								//  room for the largest numbers
+	
+	for (uint8_t id = 0; id < PROF_COUNT; id++)
+	{
+		prof_format(line, id, 0);
+		put(line);
+		prof_format(line, id, 1);
+		put(line);
+	}
+}
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * prof.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To measure where the time goes in the drivers on real hardware.
+ *
+ *          If PROFILE is defined in the project's symbols, the drivers count how often
+ *          their hot paths are called, how long they take in total and at most, and how
+ *          many bus errors they see:
+ *
+ *          PROF_TWI        bus time from twi_open to twi_close, failed connections 
+ *                          and failed background transactions
+ *          PROF_OWI        owi_detect_presence, no presence pulse
+ *          PROF_LCD        transmission of a command or a string to the display
+ *          PROF_DS1307     DS1307::update, no response
+ *          PROF_DS18B20    ds18b20_read_temp_fixed and ds18b20_device_read, also when
+ *                          called by ds18b20_read_all, no response or CRC error
+ *
+ *          Durations are measured with timer_micros(), so timer/counter 0 must be running, 
+ *          see timer.h. prof_dump() formats the counters as pairs of 16 character lines, 
+ *          for an LCD or a UART:
+ *
+ *          TWI n1234 e0
+ *          max460 avg212us
+ *
+ *          The counters are labeled TWI, OWI, LCD, RTC (DS1307) and TMP (DS18B20).
+ *
+ *          If PROFILE is not defined, the macros are empty and nothing is measured, so
+ *          there is no cost at all. prof.c must then not be part of the build, or it
+ *          compiles to nothing.
+ *
+ * Limitations:
+ *
+ *          Measuring takes a few microseconds per call, which is included in the results.
+ *          Durations in one call are at most 65535us, longer calls count as 65535us.
+ *
+ * Dependencies:
+ *
+ *          stdint.h:     This library uses fixed width integer types.
+ *          timer.h:      Durations are measured in microseconds.
+ *          util/atomic.h:
+ *                        Counters can be updated from interrupts.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+enum PROF_ID {PROF_TWI = 0, PROF_OWI, PROF_LCD, PROF_DS1307, PROF_DS18B20, PROF_COUNT};
+
+#ifdef PROFILE
+
+#include "timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct prof_counter
+{
+	uint32_t calls;								//  number of calls
+	uint32_t total;								//  total duration, microseconds
+	uint16_t max;								//  longest duration, microseconds
+	uint16_t errors;							//  number of bus errors
+};
+
+/*
+ *     Add one call of us microseconds to a counter.
+ */
+void prof_record(uint8_t id, uint32_t us);
+
+/*
+ *     Add one bus error to a counter.
+ */
+void prof_error(uint8_t id);
+
+/*
+ *     Copy a counter, read with interrupts disabled.
+ *
+ *     \param id        PROF_TWI - PROF_DS18B20.
+ *     \param *counter  The copy.
+ */
+void prof_get(uint8_t id, struct prof_counter *counter);
+
+/*
+ *     Clear all counters.
+ */
+void prof_reset(void);
+
+/*
+ *     Format line 0 or 1 of a counter, see above.
+ *
+ *     \param *p        Buffer for at least 24 characters, 16 are used unless the numbers are large.
+ *     \param id        PROF_TWI - PROF_DS18B20.
+ *     \param line      0 for calls and errors, 1 for max and average duration.
+ *     \return          Pointer to the terminating NUL character.
+ */
+char *prof_format(char *p, uint8_t id, uint8_t line);
+
+/*
+ *     Format all counters, two lines each, and pass each line to put, f.ex a
+ *     function that prints it on the display or sends it on a UART.
+ */
+void prof_dump(void (*put)(const char *line));
+
+#ifdef __cplusplus
+}
+#endif
+
+#define PROF_START(t)      uint32_t t = timer_micros()
+#define PROF_STOP(id, t)   prof_record(id, timer_micros() - (t))
+#define PROF_ERROR(id)     prof_error(id)
+
+#else
+
+#define PROF_START(t)
+#define PROF_STOP(id, t)   ((void)0)
+#define PROF_ERROR(id)     ((void)0)
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * scheduler.c
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To run periodic tasks from the main loop without blocking delays.
+ *
+ * Dependencies:
+ *
+ *          scheduler.h
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stddef.h>
+#include <avr/sleep.h>
+#include "hal.h"
+#include "timer.h"
+#include "scheduler.h"
+
+
+/*
+ *     A slot in the task table. A slot is free when task is NULL.
+ */
+struct sched_slot
+{
+	sched_task task;
+	void      *arg;
+	uint16_t   period;							//  milliseconds between runs
+	uint32_t   due;								//  timestamp of the next run
+};
+
+static struct sched_slot _sched_table[SCHED_TASKS];
+static uint32_t          _sched_busy = 0;					//  microseconds spent in tasks
+
+
+int sched_add(sched_task task, void *arg, uint16_t period, uint16_t delay)
+{
+	int found = -1;
+	
+	if (!task || !period) return -1;
+	
+		//  find and claim the slot in one step, or an interrupt could claim it in between
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (int id = 0; id < SCHED_TASKS; id++)
+		{
+			struct sched_slot *slot = &_sched_table[id];
+			if (slot -> task) continue;
+			
+			slot -> arg    = arg;
+			slot -> period = period;
+			slot -> due    = timer_millis() + delay;
+			slot -> task   = task;
+			found = id;
+			break;
+		}
+	}
+	return found;
+}
+
+
+
+void sched_remove(int id)
+{
+	if (id < 0 || id >= SCHED_TASKS) return;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)					//  the pointer is 2 bytes
+	{
+		_sched_table[id].task = NULL;
+	}
+}
+
+
+
+void sched_set_period(int id, uint16_t period)
+{
+	if (id < 0 || id >= SCHED_TASKS || !period) return;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_sched_table[id].period = period;
+		_sched_table[id].due    = timer_millis() + period;
+	}
+}
+
+
+
+void sched_restart(int id)
+{
+	if (id < 0 || id >= SCHED_TASKS) return;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_sched_table[id].due = timer_millis() + _sched_table[id].period;
+	}
+}
+
+
+
+uint8_t sched_run(void)
+{
+	uint8_t n = 0;
+	
+	for (int id = 0; id < SCHED_TASKS; id++)
+	{
+		struct sched_slot *slot = &_sched_table[id];
+		sched_task task;
+		void      *arg;
+		
+			//  take the task out of the slot, so an interrupt can't change it half way
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			task = slot -> task;
+			arg  = slot -> arg;
+			if (task && timer_expired(slot -> due))
+			{
+				slot -> due += slot -> period;
+				if (timer_expired(slot -> due)) slot -> due = timer_millis() + slot -> period;	//  more than one period behind, skip
+			}
+			else task = NULL;
+		}
+		if (!task) continue;
+		
+		uint32_t start = timer_micros();
+		task(arg);
+		_sched_busy += timer_micros() - start;
+		n++;
+	}
+	return n;
+}
+
+
+
+uint16_t sched_next_due(void)
+{
+	uint32_t now  = timer_millis();
+	uint16_t next = 0xFFFF;
+	
+	for (int id = 0; id < SCHED_TASKS; id++)
+	{
+		struct sched_slot *slot = &_sched_table[id];
+		int32_t wait;
+		
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			wait = slot -> task ? (int32_t)(slot -> due - now) : 0xFFFF;
+		}
+		if (wait <= 0) return 0;
+		if (wait < next) next = wait;
+	}
+	return next;
+}
+
+
+
+uint32_t sched_busy_time(void)
+{
+	uint32_t busy = _sched_busy;
+	
+	_sched_busy = 0;
+	return busy;
+}
+
+
+
+
+void sched_idle(void)
+{
+	set_sleep_mode(SCHED_SLEEP_MODE);
+	
+		//  with interrupts disabled, no interrupt can make a task due between the
+		//  test and sleep_cpu. sei always executes the next instruction first.
+	cli();
+	if (sched_next_due())
+	{
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+	sei();
+}
@@ -0,0 +1,157 @@
+/*
+ * scheduler.h
+ *
+ * Version: 1.0.0
+ * Created: 14.10.2026
+ *  Author: Frank Bjørnø
+ *
+ * Purpose: To run periodic tasks from the main loop without blocking delays.
+ *
+ *          A task is a function that does a small piece of work and returns. Each task
+ *          has a period in milliseconds, and sched_run() calls the tasks that are due.
+ *          The main loop of a program then becomes:
+ *
+ *          timer_init();                              //  or construct a Timer
+ *          sched_add(read_sensor, NULL, 1000, 0);
+ *          sched_add(refresh_display, NULL, 100, 50);
+ *          while (1)
+ *          {
+ *              sched_run();
+ *              sched_idle();                          //  sleep until the next interrupt
+ *          }
+ *
+ *          The tasks are kept in a fixed table of SCHED_TASKS slots, so no memory is
+ *          allocated. The time is read with timer_millis(), so the timer/counter 0 
+ *          interrupt must be enabled and increment a Timer, see timer.h.
+ *
+ * Limitations:
+ *
+ *          The scheduler is cooperative. A task is never interrupted by another task, so
+ *          a task that takes a long time delays all the others.
+ *
+ *          If a task falls more than one period behind, the missed runs are skipped 
+ *          instead of run back to back.
+ *
+ *          sched_idle() uses the idle sleep mode by default. The deeper sleep modes stop 
+ *          the clock of timer/counter 0, so the millisecond count stops with them, and a
+ *          program that uses them must be woken by an external interrupt.
+ *
+ * Dependencies:
+ *
+ *          stdint.h:     This library uses fixed width integer types.
+ *          timer.h:      The scheduler uses the millisecond and microsecond timestamps.
+ *          util/atomic.h:
+ *                        Tasks can be added, removed and restarted from an interrupt.
+ *          avr/sleep.h:  sched_idle() puts the MCU to sleep.
+ *
+ * License:
+ *
+ *          Copyright (C) 2026 Frank Bjørnø
+ *
+ *          1. Permission is hereby granted, free of charge, to any person obtaining a copy
+ *          of this software and associated documentation files (the "Software"), to deal
+ *          in the Software without restriction, including without limitation the rights
+ *          to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ *          of the Software, and to permit persons to whom the Software is furnished to do
+ *          so, subject to the following conditions:
+ *
+ *          2. The above copyright notice and this permission notice shall be included in all
+ *          copies or substantial portions of the Software.
+ *
+ *          3. THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ *          INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ *          PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ *          HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+ *          CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+ *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SCHED_TASKS
+#define SCHED_TASKS 8								//  number of task slots
+#endif
+
+#ifndef SCHED_SLEEP_MODE
+#define SCHED_SLEEP_MODE SLEEP_MODE_IDLE					//  sleep mode used by sched_idle
+#endif
+
+/*
+ *     A task is called with the argument given to sched_add, f.ex an object 
+ *     pointer for a C++ member function behind a static wrapper.
+ */
+typedef void (*sched_task)(void *arg);
+
+/*
+ *     Add a task that runs every period milliseconds, the first time after delay
+ *     milliseconds.
+ *
+ *     \param task      The function to call.
+ *     \param *arg      The argument to the function.
+ *     \param period    Milliseconds between runs, 1 - 65535.
+ *     \param delay     Milliseconds until the first run.
+ *     \return          The slot number of the task (0 - SCHED_TASKS-1), or
+ *                      -1 if all slots are in use.
+ */
+int sched_add(sched_task task, void *arg, uint16_t period, uint16_t delay);
+
+/*
+ *     Remove a task.
+ *
+ *     \param id        The slot number returned by sched_add.
+ */
+void sched_remove(int id);
+
+/*
+ *     Change the period of a task. The next run is one new period from now.
+ *
+ *     \param id        The slot number returned by sched_add.
+ *     \param period    Milliseconds between runs, 1 - 65535.
+ */
+void sched_set_period(int id, uint16_t period);
+
+/*
+ *     Restart the period of a task, so it next runs one period from now.
+ *
+ *     \param id        The slot number returned by sched_add.
+ */
+void sched_restart(int id);
+
+/*
+ *     Call every task that is due. Call this from the main loop.
+ *
+ *     \return          The number of tasks that were called.
+ */
+uint8_t sched_run(void);
+
+/*
+ *     The number of milliseconds until the next task is due, 0 if a task is due
+ *     now. Returns 0xFFFF if there are no tasks.
+ */
+uint16_t sched_next_due(void);
+
+/*
+ *     The number of microseconds spent in tasks since the last call. The rest of
+ *     the time is idle time, which can be used for something else or for sleep.
+ */
+uint32_t sched_busy_time(void);
+
+/*
+ *     Sleep until the next interrupt if no task is due. Call this from the main
+ *     loop after sched_run(). In idle mode, the timer/counter 0 interrupt wakes
+ *     the MCU every millisecond, and any other interrupt, f.ex an external interrupt
+ *     or a TWI or 1-wire transmission in the background, wakes it as well.
+ *
+ *     Note:  Global interrupts must be enabled. They are enabled on return.
+ */
+void sched_idle(void);
+
+#ifdef __cplusplus
+}
+#endif
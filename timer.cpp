@@ -1,36 +1,48 @@
 /*
- * timer.h
+ * timer.cpp
  *
  * Version: 1.0.0
  * Created: 16.12.2020
- *  Author: Frank Bjrn
+ *  Author: Frank Bjørnø
  *
  * Purpose:	
  *
  *          To use the internal timer/counter of the AtMega328p to count milliseconds
  *          between short periods of time. The main application is to time the main loop
- *          of a program. 
+ *          of a program, and to timestamp events. 
  *
- * Limitations:
+ *          Timer/counter 0 runs in CTC mode and interrupts once every millisecond. The
+ *          application must define the interrupt service routine and increment a Timer
+ *          from it:
+ *
+ *          static Timer timer;
+ *          ISR(TIMER0_COMPA_vect) {timer++;}
+ *
+ *          All Timer objects share one free running 32 bit count of milliseconds, so any
+ *          number of Timers can be started and stopped independently. The count can also
+ *          be read with timer_millis() and timer_micros(), which can be called from C.
  *
- *          Timer uses an unsigned int (16 bits in Atmel Studio) to count milliseconds. 
- *          This limits the timer to about 65536ms, which should be ample for its main 
- *          application.
+ *          Timestamps wrap around, after about 49 days for milliseconds and 71 minutes
+ *          for microseconds. Compare timestamps with timer_elapsed_ms() or timer_expired(),
+ *          which are correct across a wraparound, and never with < or >.
  *
- *          Timer only gives an approximate measure of milliseconds and should never 
- *          be used for anything where accuracy is an issue.
+ * Limitations:
  *
  *          Timer assumes that the MCU is driven by a 16MHz crystal. Using a different 
- *          crystal requires changes to register TCCR0B and OCR0A, initialized in the
- *          constructor. The Datasheet should be consulted.
+ *          crystal requires changes to register TCCR0B and OCR0A, initialized in
+ *          timer_init(), and to TIMER_US_PER_COUNT. The Datasheet should be consulted.
+ *
+ *          The resolution of timer_micros() is 4 microseconds.
  *
  * Dependencies:
+ *          stdint.h:     This library uses fixed width integer types.
  *          avr/io.h:     This library uses definitions in this header.
- *                        it to process the data. 
+ *          util/atomic.h:
+ *                        The millisecond count is read with interrupts disabled.
  *
  * License:
  * 
- *          Copyright (C) 2021 Frank Bjrn
+ *          Copyright (C) 2021 Frank Bjørnø
  *
  *          1. Permission is hereby granted, free of charge, to any person obtaining a copy 
  *          of this software and associated documentation files (the "Software"), to deal 
@@ -50,15 +62,22 @@
  *          OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */ 
 
-#include <avr/io.h>
+#include "hal.h"
 #include "timer.h"
 
+#define TIMER_US_PER_COUNT 4							//  16MHz / 64 = 250kHz
+
+
+/*
+ *     The millisecond count is shared by all Timer objects.
+ */
+static volatile uint32_t _millis = 0;
 
 
 /*
- *     set timer A to roughly count milliseconds
+ *     set timer 0 to count milliseconds
  */
-Timer::Timer() : _count{0}
+void timer_init(void)
 {
 	/*
 	 *  TCCR0A - Timer/Counter 0 Control Register A
@@ -69,7 +88,7 @@ Timer::Timer() : _count{0}
 	 *
 	 *
 	 *  WGM01 = 1: CTC (Clear Timer on Compare match) mode
-	 *  WGM00 = 0: TCNT0 will count up to 255, then signal timer 0 compare interrupt
+	 *  WGM00 = 0: TCNT0 will count up to OCR0A, then signal timer 0 compare interrupt
 	 */
 	TCCR0A = 0x02;
 	
@@ -78,20 +97,20 @@ Timer::Timer() : _count{0}
 	 *
 	 *  bit        7       6        5        4      3      2      1     0
 	 *  name     FOC0A   FOC0B      -        -    WGM02   CS02   CS01  CS00
-	 *  set to     0       0        0        0      0      1      0     1
+	 *  set to     0       0        0        0      0      0      1     1
 	 *
-	 *  CSC02 = 1
-	 *  CSC01 = 0		clock / 1024
+	 *  CSC02 = 0
+	 *  CSC01 = 1		clock / 64
 	 *  CSC00 = 1
 	 */
-	TCCR0B = 0x05;
+	TCCR0B = 0x03;
 	
 	/*
-	 *     count to 16 before resetting the timer/counter
-	 *     this makes _count a rough measure of milliseconds
-	 *     16Mhz / 1024 = 16384 and 16384 / 16 = 1024
+	 *     count 250 times, 0 - 249, before resetting the timer/counter
+	 *     this makes the interrupt come once every millisecond
+	 *     16Mhz / 64 = 250kHz and 250kHz / 250 = 1kHz
 	 */
-	OCR0A = 0x10;			// 16
+	OCR0A = 249;
 	
 	/*
 	 *  TIMSK0 - Timer/Counter 0 Interrupt Mask Register
@@ -101,29 +120,97 @@ Timer::Timer() : _count{0}
 	 *  set to     0       0       0       0       0       0      1      0
 	 *
 	 *  OCIE0B = 0  disable Timer/Counter 0 Output Compare Match B Interrupt
-	 *  OCIE0A = 0  disable Timer/Counter 0 Output Compare Match A Interrupt
-	 *  TOIE0  = 1  enable Timer/Counter 0 Overflow Interrupt
+	 *  OCIE0A = 1  enable Timer/Counter 0 Output Compare Match A Interrupt
+	 *  TOIE0  = 0  disable Timer/Counter 0 Overflow Interrupt
 	 */	
 	TIMSK0 = 0x02;
 }
 
+/*
+ *     Get the number of milliseconds since timer_init().
+ *
+ *     \return     Milliseconds, wraps around after about 49 days.
+ */
+uint32_t timer_millis(void)
+{
+	uint32_t ms;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ms = _millis;
+	}
+	return ms;
+}
+
+/*
+ *     Get the number of microseconds since timer_init(), from the millisecond
+ *     count and the timer/counter.
+ *
+ *     \return     Microseconds, wraps around after about 71 minutes.
+ */
+uint32_t timer_micros(void)
+{
+	uint32_t ms;
+	uint8_t  count;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		ms    = _millis;
+		count = TCNT0;
+		
+			//  the counter has been cleared, but the interrupt is not serviced yet
+		if ((TIFR0 & (1 << OCF0A)) && count < 249) ms++;
+	}
+	return ms * 1000 + count * TIMER_US_PER_COUNT;
+}
+
+/*
+ *     Count one millisecond.
+ *
+ *     Note: There is, in general, no point in calling this from any 
+ *           other point in the program than from a Timer ISR
+ */
+void timer_tick(void)
+{
+	_millis++;
+}
+
+/*
+ *     Constructor. Configures timer/counter 0.
+ */
+Timer::Timer() : _start{0}
+{
+	timer_init();
+}
+
 /*
  *     Start the timer
  */
 void Timer::start()
 {
-	
-	_count = 0;
+	_start = timer_millis();
 }
 
 /*
  *     Stop the timer
  *
- *     \return     number of milliseconds since last start
+ *     \return     number of milliseconds since last start, at most 65535
  */
 unsigned int Timer::stop()
 {
-	return _count;
+	uint32_t ms = elapsed();
+	
+	return (ms > 0xFFFF) ? 0xFFFF : (unsigned int)ms;
+}
+
+/*
+ *     Get the time since the timer was started. The timer keeps running.
+ *
+ *     \return     number of milliseconds since last start
+ */
+uint32_t Timer::elapsed() const
+{
+	return timer_millis() - _start;
 }
 
 /*
@@ -134,7 +221,7 @@ unsigned int Timer::stop()
  */
 void Timer::operator++()
 {
-	_count++;
+	_millis++;
 }
 
 /*
@@ -145,5 +232,5 @@ void Timer::operator++()
  */
 void Timer::operator++(int)
 {
-	_count++;
+	_millis++;
 }
\ No newline at end of file
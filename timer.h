@@ -9,24 +9,36 @@
  *
  *          To use the internal timer/counter of the AtMega328p to count milliseconds
  *          between short periods of time. The main application is to time the main loop
- *          of a program. 
+ *          of a program, and to timestamp events. 
  *
- * Limitations:
+ *          Timer/counter 0 runs in CTC mode and interrupts once every millisecond. The
+ *          application must define the interrupt service routine and increment a Timer
+ *          from it:
+ *
+ *          static Timer timer;
+ *          ISR(TIMER0_COMPA_vect) {timer++;}
  *
- *          Timer uses an unsigned int (16 bits in Atmel Studio) to count milliseconds. 
- *          This limits the timer to about 65536ms, which should be ample for its main 
- *          application.
+ *          All Timer objects share one free running 32 bit count of milliseconds, so any
+ *          number of Timers can be started and stopped independently. The count can also
+ *          be read with timer_millis() and timer_micros(), which can be called from C.
  *
- *          Timer only gives an approximate measure of milliseconds and should never 
- *          be used for anything where accuracy is an issue.
+ *          Timestamps wrap around, after about 49 days for milliseconds and 71 minutes
+ *          for microseconds. Compare timestamps with timer_elapsed_ms() or timer_expired(),
+ *          which are correct across a wraparound, and never with < or >.
+ *
+ * Limitations:
  *
  *          Timer assumes that the MCU is driven by a 16MHz crystal. Using a different 
- *          crystal requires changes to register TCCR0B and OCR0A, initialized in the
- *          constructor. The Datasheet should be consulted.
+ *          crystal requires changes to register TCCR0B and OCR0A, initialized in
+ *          timer_init(), and to TIMER_US_PER_COUNT. The Datasheet should be consulted.
+ *
+ *          The resolution of timer_micros() is 4 microseconds.
  *
  * Dependencies:
+ *          stdint.h:     This library uses fixed width integer types.
  *          avr/io.h:     This library uses definitions in this header.
- *                        it to process the data. 
+ *          util/atomic.h:
+ *                        The millisecond count is read with interrupts disabled.
  *
  * License:
  * 
@@ -52,15 +64,53 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ *     Configure timer/counter 0 to interrupt once every millisecond. The Timer 
+ *     constructor calls this, C programs must call it themselves.
+ */
+void timer_init(void);
+
+/*
+ *     Milliseconds and microseconds since timer_init(). Safe to call with
+ *     interrupts enabled or disabled, but microseconds are only correct if
+ *     the timer interrupt is serviced at least once every millisecond.
+ */
+uint32_t timer_millis(void);
+uint32_t timer_micros(void);
+
+/*
+ *     Count one millisecond. Called from the timer interrupt.
+ */
+void timer_tick(void);
+
+/*
+ *     Milliseconds since a timestamp, and whether a deadline has been reached.
+ *     Both are correct across a wraparound, as long as the times compared are
+ *     less than about 24 days apart.
+ */
+static inline uint32_t timer_elapsed_ms(uint32_t since) {return timer_millis() - since;}
+static inline uint8_t  timer_expired(uint32_t deadline) {return (int32_t)(timer_millis() - deadline) >= 0;}
+
+#ifdef __cplusplus
+}
+
 class Timer
 {
 	public:
 		Timer();
-		void start();				//  resets milliseconds count
-		unsigned int stop();			//  returns number of milliseconds since start (roughly)
+		void start();				//  remembers the current time
+		unsigned int stop();			//  returns number of milliseconds since start, at most 65535
+		uint32_t elapsed() const;		//  returns number of milliseconds since start
 		
 		void operator++();			//  prefix increase number of milliseconds. generally called from timer interrupt
 		void operator++(int);			//  postfix
 	private:	
-		unsigned int _count;
+		uint32_t _start;			//  timestamp of the last start
 };
+#endif
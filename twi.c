@@ -67,8 +67,17 @@
 #define F_TWI 100000ul						//  100kbps is standard mode
 #endif
 
-#include <avr/io.h						//  contains definitions of f.ex. PORTC and DDRC
+#ifndef TWI_SPEED_TABLE_SIZE
+#define TWI_SPEED_TABLE_SIZE 4						//  maximum number of devices with their own SCL frequency
+#endif
+
+#ifndef TWI_QUEUE_SIZE
+#define TWI_QUEUE_SIZE 4						//  maximum number of queued asynchronous transactions
+#endif
+
+#include "hal.h"							//  contains definitions of f.ex. PORTC and DDRC
 #include "twi.h"
+#include "prof.h"
 
 /*
  *     The TWI bus connections on an Atmega328 are pins 4 and 5 on PORT C.
@@ -97,6 +106,15 @@
 #define TWI_RETURN_ACK         0xC4       //      |   1   |   1  |   0   |   0   |   0  |   1  |  0  |   0  |
 #define TWI_RETURN_NACK        0x84       //      |   1   |   0  |   0   |   0   |   0  |   1  |  0  |   0  |
 
+/*
+ *     The same operations with the TWI interrupt enabled, used by the asynchronous interface.
+ */
+#define TWI_START_CONDITION_INT    0xA5   //      |   1   |   0  |   1   |   0   |   0  |   1  |  0  |   1  |
+#define TWI_STOP_START_INT         0xB5   //      |   1   |   0  |   1   |   1   |   0  |   1  |  0  |   1  |
+#define TWI_START_TRANSMISSION_INT 0x85   //      |   1   |   0  |   0   |   0   |   0  |   1  |  0  |   1  |
+#define TWI_RETURN_ACK_INT         0xC5   //      |   1   |   1  |   0   |   0   |   0  |   1  |  0  |   1  |
+#define TWI_RETURN_NACK_INT        0x85   //      |   1   |   0  |   0   |   0   |   0  |   1  |  0  |   1  |
+
 /*
  *     Status codes for master transmitter (MT) and master receiver (MR) mode. 
  */
@@ -113,6 +131,52 @@
 
 static unsigned char _twi_enabled = 0;							//  keep track of i2c initialization
 static unsigned char _twi_address = 0x00;						//  keep track of address for repeat start condition
+static unsigned char _twi_open    = 0;							//  set while a blocking connection is open
+#ifdef PROFILE
+static uint32_t      _twi_opened  = 0;							//  timestamp of twi_open, for the bus time
+#endif
+
+/*
+ *     The SCL frequency is given by F_CPU / (16 + 2 * TWBR * 4^TWPS). A twi_speed 
+ *     holds the register values for one frequency. The default is F_TWI with 
+ *     prescaler 1, and devices with a frequency of their own are kept in a table.
+ */
+struct twi_speed
+{
+	unsigned char address;
+	unsigned char twbr;
+	unsigned char twps;
+};
+
+static struct twi_speed _twi_default = {0x00, ((F_CPU / F_TWI) - 16) / 2, 0};
+static struct twi_speed _twi_speeds[TWI_SPEED_TABLE_SIZE];
+static unsigned char    _twi_nspeeds = 0;
+
+/*
+ *     Queue of asynchronous transactions. The transaction at _twi_head is the one 
+ *     in progress. _twi_index counts the data bytes transferred so far and 
+ *     _twi_reg_pending is set until the register has been transmitted.
+ */
+static struct twi_transaction *_twi_queue[TWI_QUEUE_SIZE];
+static volatile unsigned char  _twi_head  = 0;
+static volatile unsigned char  _twi_count = 0;
+static volatile unsigned char  _twi_running = 0;
+static unsigned char           _twi_index = 0;
+static unsigned char           _twi_reg_pending = 0;
+
+static void twi_start_next(unsigned char control);
+
+
+
+/*
+ *     Wait for the TWI module to finish the current operation, that is,
+ *     for the TWINT flag to be set.
+ */
+static inline void twi_wait(void)
+{
+	while (!(TWCR & TWI_INTERRUPT_FLAG)) HAL_POLL();
+}
+
 
 
 /******************************************************************************************************
@@ -135,7 +199,8 @@ void twi_enable(void)
 		/*
 		 *     Set TWI bit rate.
 		 */			
-	TWBR = ((F_CPU / F_TWI) - 16) / 2;
+	TWBR = _twi_default.twbr;
+	TWSR = _twi_default.twps;
 	
 		/*	 
 		 *     Set enable acknowledge bit (TWEA), enable TWI module (TWEN), 
@@ -162,13 +227,166 @@ int twi_is_enabled(void)
 	return _twi_enabled;
 }
 
+/******************************************************************************************************
+ *                                            BIT RATE                                                *
+ ******************************************************************************************************/
+
+/*
+ *     Compute TWBR and the prescaler for a given SCL frequency.
+ *
+ *     \param  scl      SCL frequency in Hz.
+ *     \param *speed    Receives the register values.
+ *     \return          1 if successful, 0 if the frequency is out of range.
+ */
+static int twi_compute_speed(unsigned long scl, struct twi_speed *speed)
+{
+	if (scl == 0) return 0;
+	
+		//  Round the divider up, so the frequency never exceeds scl.
+	unsigned long div = (F_CPU + scl - 1) / scl;
+	if (div < 16) return 0;							//  too fast, even with TWBR = 0
+	
+		//  Try prescaler 1, 4, 16 and 64, and use the first one where TWBR fits in 8 bits.
+	unsigned long k = div - 16;
+	for (unsigned char ps = 0; ps < 4; ps++)
+	{
+		unsigned long step = 2ul << (2 * ps);					//  2 * 4^TWPS
+		unsigned long twbr = (k + step - 1) / step;
+		if (twbr <= 0xFF)
+		{
+			speed->twbr = twbr;
+			speed->twps = ps;
+			return 1;
+		}
+	}
+	return 0;									//  too slow, even with prescaler 64
+}
+
+
+
+/*
+ *     Find the register values for a device, its own if it has any, else the default.
+ *
+ *     \param address    7 bit i2c address
+ */
+static const struct twi_speed *twi_find_speed(unsigned char address)
+{
+	const struct twi_speed *speed = &_twi_default;
+	for (unsigned char i = 0; i < _twi_nspeeds; i++)
+	{
+		if (_twi_speeds[i].address == address) speed = &_twi_speeds[i];
+	}
+	return speed;
+}
+
+
+
+/*
+ *     Load the register values for a device into TWBR and TWSR. Only call this
+ *     while the bus is idle.
+ *
+ *     \param address    7 bit i2c address
+ */
+static void twi_select_speed(unsigned char address)
+{
+	const struct twi_speed *speed = twi_find_speed(address);
+	
+	if (TWBR != speed->twbr) TWBR = speed->twbr;
+	if ((TWSR & 0x03) != speed->twps) TWSR = speed->twps;			//  only the prescaler bits are writable
+}
+
+
+
+int twi_set_speed(unsigned long scl)
+{
+	struct twi_speed speed;
+	if (!twi_compute_speed(scl, &speed)) return 0;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)						//  the ISR reads the settings
+	{
+		_twi_default.twbr = speed.twbr;
+		_twi_default.twps = speed.twps;
+	}
+	return 1;
+}
+
+
+
+int twi_set_device_speed(unsigned char address, unsigned long scl)
+{
+	unsigned char i = 0;
+	while (i < _twi_nspeeds && _twi_speeds[i].address != address) i++;
+	
+	if (scl == 0)									//  remove the entry, if any
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (i < _twi_nspeeds) _twi_speeds[i] = _twi_speeds[--_twi_nspeeds];
+		}
+		return 1;
+	}
+	
+	struct twi_speed speed;
+	if (!twi_compute_speed(scl, &speed)) return 0;
+	if (i == TWI_SPEED_TABLE_SIZE) return 0;					//  table is full
+	
+	speed.address = address;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		_twi_speeds[i] = speed;
+		if (i == _twi_nspeeds) _twi_nspeeds++;
+	}
+	return 1;
+}
+
+
+
+unsigned long twi_get_speed(unsigned char address)
+{
+	unsigned long div;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		const struct twi_speed *speed = twi_find_speed(address);
+		div = 16 + ((unsigned long)speed->twbr << (2 * speed->twps + 1));	//  16 + 2 * TWBR * 4^TWPS
+	}
+	return F_CPU / div;
+}
+
+
+
 /******************************************************************************************************
  *                                          OPEN / CLOSE                                              *
  ******************************************************************************************************/
 
-int twi_open(unsigned char address)
+/*
+ *     Generate a start condition, or a repeated start condition if the connection
+ *     is already open, and transmit SLA+W or SLA+R. twi_open and twi_open_read
+ *     use this.
+ *
+ *     \param address    7 bit i2c address
+ *     \param read       0 for SLA+W, 1 for SLA+R
+ *     \return           1 if successful, 0 if not.
+ */
+static int twi_connect(unsigned char address, unsigned char read)
 {
+		//  The bus can't be shared with an asynchronous transaction in progress.
+		//  Wait for the queue to drain, then hold it off until twi_close.
+	unsigned char ready = 0;
+#ifdef PROFILE
+	if (!_twi_open) _twi_opened = timer_micros();				//  a repeated start continues the same connection
+#endif
+	while (!ready)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			ready = !_twi_running;
+			_twi_open = ready;
+		}
+	}
+	
 	_twi_address = address;
+	twi_select_speed(address);
 	
 		/*
 		 *     1. Send start condition.
@@ -176,27 +394,61 @@ int twi_open(unsigned char address)
 		 *     3. check value of TWI status register. Mask prescaler bits. Status != START indicates error.
 		 */
 	TWCR = TWI_START_CONDITION;							//  1.	send start condition		
-	while (!(TWCR & TWI_INTERRUPT_FLAG));						//  2.	wait for TWINT flag.
-	if ((TWSR & TWI_PRESCALER_MASK) != TWI_START) return 0;				//  3.  check value of status register while masking prescaler bits 
+	twi_wait();													//  2.	wait for TWINT flag.
+	unsigned char status = TWSR & TWI_PRESCALER_MASK;				//  3.  check value of status register while masking prescaler bits 
+	if (status != TWI_START && status != TWI_REP_START)
+	{
+		PROF_ERROR(PROF_TWI);
+		return 0;
+	}
 	
 		/*
-		 *     3. Transmit SLA + W.
+		 *     3. Transmit SLA + W or SLA + R.
 		 *     4. Wait for TWINT flag to clear.
 		 *     5. Verify that slave has acknowledged.
 		 */	
-	TWDR = (_twi_address << 1);							//  Load SLA + W into TWI data register
+	TWDR = (_twi_address << 1) | read;						//  Load SLA + W/R into TWI data register
 	TWCR = TWI_START_TRANSMISSION;							//  3.  Set TWI interrupt bit to start transmission of address	
-	while (!(TWCR & TWI_INTERRUPT_FLAG));						//  4.	wait for TWINT flag to clear.
-	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MT_SLA_ACK) return 0;			//  5.  verify MT_SLA_ACK is received
+	twi_wait();													//  4.	wait for TWINT flag to clear.
+	if ((TWSR & TWI_PRESCALER_MASK) != (read ? TWI_MR_SLA_ACK : TWI_MT_SLA_ACK))	//  5.  verify SLA_ACK is received
+	{
+		PROF_ERROR(PROF_TWI);
+		return 0;
+	}
 	
 	return 1;									//  connection open
 }
 
 
 
+int twi_open(unsigned char address)
+{
+	return twi_connect(address, 0);
+}
+
+
+
+int twi_open_read(unsigned char address)
+{
+	return twi_connect(address, 1);
+}
+
+
+
 void twi_close(void)
 {	
-	TWCR = TWI_STOP_CONDITION;
+	PROF_STOP(PROF_TWI, _twi_opened);
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+			//  Release the bus in the same atomic block, or twi_submit from an ISR could 
+			//  start a transaction before the stop condition.
+		_twi_open = 0;
+		
+			//  Transactions submitted while the connection was open start after the stop condition.
+		if (_twi_count) twi_start_next(TWI_STOP_START_INT);
+		else TWCR = TWI_STOP_CONDITION;
+	}
 }
 
 /******************************************************************************************************
@@ -214,7 +466,7 @@ int twi_write_ch(unsigned char data)
 		 */
 	TWDR = data;
 	TWCR = TWI_START_TRANSMISSION;							// 1.
-	while(!(TWCR & TWI_INTERRUPT_FLAG));						// 2. 
+	twi_wait();													// 2. 
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MT_DATA_ACK) return 0;			// 3.
 	
 	return 1;
@@ -222,15 +474,15 @@ int twi_write_ch(unsigned char data)
 
 
 
-int twi_write_str(const char *data, int n)
+int twi_write_str(const unsigned char *data, int n)
 {
 	/*
 	 *     Calls twi_write for each character.
 	 */
-	const char *ptr = data;
+	const unsigned char *ptr = data;
 	for (int c = 0; c < n; c++)
 	{
-		if (!twi_write_ch(*ptr)) return 0;
+		if (!twi_write_ch(*ptr++)) return 0;
 	}
 	return 1;
 }
@@ -255,14 +507,14 @@ static int twi_register(unsigned char reg)
 		
 	TWDR = reg;
 	TWCR = TWI_START_TRANSMISSION;							//  1.
-	while(!(TWCR & TWI_INTERRUPT_FLAG));						//  2.
+	twi_wait();													//  2.
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MT_DATA_ACK) return 0;			//  3.
 	
 		/*  
 		 *  Repeat start condition, wait for REP_START.
 		 */  
 	TWCR = TWI_START_CONDITION;
-	while (!(TWCR & TWI_INTERRUPT_FLAG));
+	twi_wait();
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_REP_START) return 0;
 	
 		/*
@@ -272,7 +524,7 @@ static int twi_register(unsigned char reg)
 		 */
 	TWDR = (_twi_address << 1) | 0x01;
 	TWCR = (TWI_START_TRANSMISSION);						//  1.
-	while(!(TWCR & TWI_INTERRUPT_FLAG));						//  2.
+	twi_wait();													//  2.
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MR_SLA_ACK) return 0;			//  3. MR_SLA_ACK = 0x40: SLA+R has been transmitted, ACK received
 	
 	return 1;
@@ -291,7 +543,7 @@ int twi_read_ch(unsigned char reg, unsigned char *data)
 		 *        is different from MR_DATA_ACK, this indicates an error.
 		 */
 	TWCR = (TWI_RETURN_NACK);							//  1. 
-	while(!(TWCR & TWI_INTERRUPT_FLAG));						//  2.
+	twi_wait();													//  2.
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MR_DATA_NACK) return 0;			//  3.
 	
 	*data = TWDR;
@@ -300,6 +552,18 @@ int twi_read_ch(unsigned char reg, unsigned char *data)
 
 
 
+int twi_receive_ch(unsigned char *data, int ack)
+{
+	TWCR = ack ? TWI_RETURN_ACK : TWI_RETURN_NACK;
+	twi_wait();
+	if ((TWSR & TWI_PRESCALER_MASK) != (ack ? TWI_MR_DATA_ACK : TWI_MR_DATA_NACK)) return 0;
+	
+	*data = TWDR;
+	return 1;
+}
+
+
+
 /*
  *     This function does the same thing as twi_read_ch, but uses
  *     a loop to read several characters in a row
@@ -312,14 +576,153 @@ int twi_read_str(unsigned char reg, unsigned char *data, int n)
 	for (int c = 0; c < n - 1; c++)
 	{
 		TWCR = TWI_RETURN_ACK;							//  read data and return ACK
-		while(!(TWCR & TWI_INTERRUPT_FLAG));
+		twi_wait();
 		if ((TWSR & TWI_PRESCALER_MASK) != TWI_MR_DATA_ACK) return 0;
 		*ptr++ = TWDR;								//  fetch data from TWI Data Register
 	}	
 	TWCR = TWI_RETURN_NACK;								//  Return NACK to stop transmission
-	while(!(TWCR & TWI_INTERRUPT_FLAG));						//  wait for interrupt flag to clear
+	twi_wait();													//  wait for interrupt flag to clear
 	if ((TWSR & TWI_PRESCALER_MASK) != TWI_MR_DATA_NACK) return 0;
 	*ptr = TWDR;									//  fetch data
 
 	return 1;
 }
+
+
+
+/******************************************************************************************************
+ *                                     ASYNCHRONOUS TRANSACTIONS                                      *
+ ******************************************************************************************************/
+
+/*
+ *     Start the transaction at the head of the queue. Must be called with
+ *     interrupts disabled or from the ISR.
+ *
+ *     \param control     TWI_START_CONDITION_INT if the bus is idle, or
+ *                        TWI_STOP_START_INT to end the current activity first.
+ */
+static void twi_start_next(unsigned char control)
+{
+	_twi_running = 1;
+	_twi_index = 0;
+	_twi_reg_pending = _twi_queue[_twi_head]->flags & TWI_REGISTER;
+	twi_select_speed(_twi_queue[_twi_head]->address);
+	TWCR = control;
+}
+
+
+
+int twi_submit(struct twi_transaction *t)
+{
+	if ((t->flags & TWI_READ) && t->n == 0) return 0;			//  can't receive zero bytes
+	
+	int result = 0;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (_twi_count < TWI_QUEUE_SIZE)
+		{
+			t->status = TWI_PENDING;
+			_twi_queue[(_twi_head + _twi_count) % TWI_QUEUE_SIZE] = t;
+			_twi_count++;
+			
+				//  Start right away, unless the bus is busy. A busy bus is picked up 
+				//  by the ISR or by twi_close when the current activity ends.
+			if (!_twi_running && !_twi_open) twi_start_next(TWI_START_CONDITION_INT);
+			result = 1;
+		}
+	}
+	return result;
+}
+
+
+
+int twi_is_busy(void)
+{
+	return _twi_count != 0;
+}
+
+
+
+/*
+ *     Complete the transaction in progress, notify the owner and move on to the 
+ *     next one in the queue.
+ *
+ *     \param status     TWI_DONE or TWI_ERROR
+ */
+static void twi_finish(unsigned char status)
+{
+	struct twi_transaction *t = _twi_queue[_twi_head];
+	
+	_twi_head = (_twi_head + 1) % TWI_QUEUE_SIZE;
+	_twi_count--;
+	t->status = status;
+	if (status == TWI_ERROR) PROF_ERROR(PROF_TWI);
+	if (t->callback) t->callback(t);					//  may submit another transaction
+	
+	if (_twi_count && !_twi_open) twi_start_next(TWI_STOP_START_INT);
+	else
+	{
+		_twi_running = 0;
+		TWCR = TWI_STOP_CONDITION;					//  stop condition, interrupt disabled
+	}
+}
+
+
+
+/*
+ *     The TWI module calls this every time it has finished an operation on the bus. 
+ *     The status register tells what happened, and the transaction in progress tells 
+ *     what to do next.
+ */
+ISR(TWI_vect)
+{
+	struct twi_transaction *t = _twi_queue[_twi_head];
+	
+	switch (TWSR & TWI_PRESCALER_MASK)
+	{
+		case TWI_START:								//  send SLA+W, or SLA+R if there is no register to send first
+		case TWI_REP_START:
+			if ((t->flags & TWI_READ) && !_twi_reg_pending) TWDR = (t->address << 1) | 0x01;
+			else TWDR = (t->address << 1);
+			TWCR = TWI_START_TRANSMISSION_INT;
+			break;
+			
+		case TWI_MT_SLA_ACK:							//  SLA+W acknowledged
+		case TWI_MT_DATA_ACK:							//  data byte acknowledged
+			if (_twi_reg_pending)
+			{
+				_twi_reg_pending = 0;
+				TWDR = t->reg;
+				TWCR = TWI_START_TRANSMISSION_INT;
+			}
+			else if (t->flags & TWI_READ)
+			{
+				TWCR = TWI_START_CONDITION_INT;				//  register sent, repeated start for SLA+R
+			}
+			else if (_twi_index < t->n)
+			{
+				TWDR = t->data[_twi_index++];
+				TWCR = TWI_START_TRANSMISSION_INT;
+			}
+			else twi_finish(TWI_DONE);
+			break;
+			
+		case TWI_MR_SLA_ACK:							//  SLA+R acknowledged. NACK the last byte.		
+			TWCR = (t->n > 1) ? TWI_RETURN_ACK_INT : TWI_RETURN_NACK_INT;
+			break;
+			
+		case TWI_MR_DATA_ACK:							//  byte received, more to come
+			t->data[_twi_index++] = TWDR;
+			TWCR = (_twi_index < t->n - 1) ? TWI_RETURN_ACK_INT : TWI_RETURN_NACK_INT;
+			break;
+			
+		case TWI_MR_DATA_NACK:							//  last byte received
+			t->data[_twi_index++] = TWDR;
+			twi_finish(TWI_DONE);
+			break;
+			
+		default:								//  NACK or lost arbitration
+			twi_finish(TWI_ERROR);
+			break;
+	}
+}
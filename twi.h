@@ -77,15 +77,68 @@ void twi_disable(void);
  */
 int twi_is_enabled(void);
 
+/*
+ *     Set the default SCL frequency. The bit rate register TWBR and the prescaler
+ *     bits in TWSR are computed from F_CPU so that the frequency is as close as
+ *     possible to, but not higher than, the requested frequency.
+ *
+ *     \param scl    SCL frequency in Hz, f.ex. 100000ul (standard mode), 400000ul 
+ *                   (fast mode) or 1000000ul (fast mode plus).
+ *     \return       1 if successful, 0 if the frequency can't be generated from F_CPU.
+ *
+ *     Note:         The default is F_TWI, which is 100kHz unless defined otherwise. The
+ *                   Atmega328P is only specified for frequencies up to 400kHz.
+ */
+int twi_set_speed(unsigned long scl);
+
+/*
+ *     Set the SCL frequency for a specific device. The frequency is selected every 
+ *     time a connection to the device is opened, so slow and fast devices can share 
+ *     the bus. Devices that have no frequency of their own use the default frequency.
+ *
+ *     \param address    7 bit i2c address
+ *     \param scl        SCL frequency in Hz. 0 removes the device's frequency.
+ *     \return           1 if successful, 0 if the frequency can't be generated or
+ *                       the table of devices is full.
+ *
+ *     Example:          Run the display at 400kHz while the DS1307 stays at 100kHz:
+ *                       twi_set_device_speed(0x27, 400000ul);
+ */
+int twi_set_device_speed(unsigned char address, unsigned long scl);
+
+/*
+ *     Get the SCL frequency a connection to a device runs at, its own frequency if
+ *     it has one, else the default frequency.
+ *
+ *     \param address    7 bit i2c address
+ *     \return           SCL frequency in Hz, as generated from F_CPU.
+ */
+unsigned long twi_get_speed(unsigned char address);
+
 /*
  *     Open a connection to a device on a given address
  *     for reading or writing
  *
  *     \param address    7 bit i2c address
  *     \return           1 if successful, 0 if not.
+ *
+ *     Note:             Calling twi_open on an open connection generates a repeated
+ *                       start condition, so a device can be written and read in one
+ *                       transaction without releasing the bus.
  */
 int twi_open(unsigned char address);
 
+/*
+ *     Open a connection to a device on a given address for reading, 
+ *     without transmitting a register first. Use twi_receive_ch to read.
+ *     Like twi_open, this generates a repeated start condition if the
+ *     connection is already open.
+ *
+ *     \param address    7 bit i2c address
+ *     \return           1 if successful, 0 if not.
+ */
+int twi_open_read(unsigned char address);
+
 /*
  *     Generate a stop condition
  */
@@ -100,13 +153,13 @@ void twi_close(void);
 int twi_write_ch(unsigned char data);
 
 /*
- *     Write a string of data. n is the length of the string.
+ *     Write a string of data on an open connection. n is the length of the string.
  *
  *     \param *data   Pointer to string of bytes to be transmitted.
  *     \param  n      Number of bytes to transmit.
  *     \return        1 if successful, 0 if not.
  */
-int  i2c_write_str(const unsigned char *data, int n);
+int twi_write_str(const unsigned char *data, int n);
 
 /*
  *     read one byte from a given register from an open connection
@@ -117,6 +170,15 @@ int  i2c_write_str(const unsigned char *data, int n);
  */
 int twi_read_ch(unsigned char reg, unsigned char *data);
 
+/*
+ *     Read one byte on a connection opened by twi_open_read.
+ *
+ *     \param *data   Pointer to a byte to receive the data.
+ *     \param  ack    1 if more bytes will be read, 0 for the last byte.
+ *     \return        1 if successful, 0 if not.
+ */
+int twi_receive_ch(unsigned char *data, int ack);
+
 /*
  *     Read a string of data
  *
@@ -127,6 +189,79 @@ int twi_read_ch(unsigned char reg, unsigned char *data);
  */
 int twi_read_str(unsigned char reg, unsigned char *data, int n);
 
+
+
+/******************************************************************************************************
+ *                                     ASYNCHRONOUS TRANSACTIONS                                      *
+ ******************************************************************************************************/
+
+/*
+ *     The functions above block until each byte has been transmitted. As an alternative,
+ *     a complete transaction can be described by a twi_transaction and handed to 
+ *     twi_submit. The transaction is then carried out by the TWI interrupt service routine
+ *     while the main program keeps working. Transactions are queued and executed in the
+ *     order they were submitted.
+ *
+ *     Example:    Read 7 bytes from register 0x00 of a DS1307 in the background
+ *                 unsigned char buffer[7];
+ *                 struct twi_transaction t = {0x68, 0x00, TWI_READ | TWI_REGISTER, buffer, 7, TWI_IDLE, 0};
+ *                 twi_submit(&t);
+ *                 ...						//  do something else
+ *                 if (t.status == TWI_DONE) ...		//  buffer holds the data
+ *
+ *     Note:       The transaction and its data buffer belong to the caller and must stay
+ *                 alive until the status is either TWI_DONE or TWI_ERROR.
+ *
+ *     Note:       Global interrupts must be enabled for the transactions to make progress.
+ */
+
+/*
+ *     Transaction status
+ */
+#define TWI_IDLE               0x00			//  not submitted
+#define TWI_PENDING            0x01			//  queued or in progress
+#define TWI_DONE               0x02			//  completed successfully
+#define TWI_ERROR              0x03			//  the slave did not respond as expected
+
+/*
+ *     Transaction flags
+ */
+#define TWI_WRITE              0x00			//  transmit n bytes from data
+#define TWI_READ               0x01			//  receive n bytes into data
+#define TWI_REGISTER           0x02			//  transmit reg before the data. A read is preceded by a repeated start.
+
+struct twi_transaction
+{
+	unsigned char  address;				//  7 bit i2c address
+	unsigned char  reg;				//  the slave's register. Only used if flags contains TWI_REGISTER.
+	unsigned char  flags;				//  TWI_WRITE or TWI_READ, optionally OR'ed with TWI_REGISTER
+	unsigned char *data;				//  bytes to transmit or buffer to receive
+	unsigned char  n;				//  number of bytes to transmit or receive
+	volatile unsigned char status;			//  TWI_IDLE, TWI_PENDING, TWI_DONE or TWI_ERROR
+	
+		/*
+		 *     Called from the interrupt service routine when the transaction has
+		 *     completed or failed. May be 0. Keep it short, and don't call any of
+		 *     the blocking functions from it. Submitting a new transaction is fine.
+		 */
+	void (*callback)(struct twi_transaction *t);
+};
+
+/*
+ *     Queue a transaction. If the bus is idle, the transaction starts immediately.
+ *
+ *     \param *t     Pointer to the transaction.
+ *     \return       1 if queued, 0 if the queue is full or the transaction is invalid.
+ */
+int twi_submit(struct twi_transaction *t);
+
+/*
+ *     Check if there are queued transactions, including the one in progress.
+ *
+ *     \return       1 if busy, 0 if idle.
+ */
+int twi_is_busy(void);
+
 #ifdef __cplusplus
 }
 #endif